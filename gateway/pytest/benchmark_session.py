@@ -0,0 +1,31 @@
+#
+# Copyright (c) 2026 Golioth, Inc.
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+
+import logging
+import re
+import statistics
+
+import pytest
+from twister_harness.device.device_adapter import DeviceAdapter
+
+pytestmark = pytest.mark.anyio
+
+SESSIONS = 10
+
+UPLINK_COMPLETE = r"Uplink complete (\d+) ms after connection"
+
+
+async def test_session_latency(dut: DeviceAdapter):
+    dut.readlines_until("Bluetooth initialized")
+
+    latencies = []
+    for _ in range(SESSIONS):
+        lines = dut.readlines_until(regex=UPLINK_COMPLETE)
+        latencies.append(int(re.search(UPLINK_COMPLETE, lines[-1]).group(1)))
+
+    logging.info("Connection to uplink completion over %d sessions: "
+                 "median %d ms, min %d ms, max %d ms",
+                 SESSIONS, statistics.median(latencies), min(latencies), max(latencies))
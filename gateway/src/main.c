@@ -33,7 +33,7 @@ struct golioth_client *client;
 
 static const struct gpio_dt_spec button = GPIO_DT_SPEC_GET_OR(DT_ALIAS(sw0), gpios, {});
 static struct gpio_callback button_cb_data;
-static struct bt_conn *default_conn;
+static struct bt_conn *pairing_conn;
 
 static const k_timeout_t bonding_timeout = K_SECONDS(30);
 static const bt_security_t bt_security =
@@ -41,10 +41,11 @@ static const bt_security_t bt_security =
 
 static void button_pressed(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
 {
-    if (default_conn)
+    if (pairing_conn)
     {
         LOG_INF("Confirming passkey");
-        bt_conn_auth_passkey_confirm(default_conn);
+        bt_conn_auth_passkey_confirm(pairing_conn);
+        pairing_conn = NULL;
     }
     else if (pouch_gateway_bonding_is_enabled())
     {
@@ -59,6 +60,7 @@ static void button_pressed(const struct device *dev, struct gpio_callback *cb, u
 #ifdef CONFIG_POUCH_GATEWAY_CLOUD
 
 static K_SEM_DEFINE(connected, 0, 1);
+static K_SEM_DEFINE(client_created, 0, 1);
 
 static void on_client_event(struct golioth_client *client,
                             enum golioth_client_event event,
@@ -89,6 +91,8 @@ static void connect_golioth_client(void)
     client = golioth_client_create(client_config);
 
     golioth_client_register_event_callback(client, on_client_event, NULL);
+
+    k_sem_give(&client_created);
 }
 
 #ifdef CONFIG_NRF_MODEM
@@ -160,7 +164,7 @@ static void connect_to_cloud(void)
 #endif
     connect_golioth_client();
 #endif
-    k_sem_take(&connected, K_FOREVER);
+    k_sem_take(&client_created, K_FOREVER);
 }
 
 #else /* CONFIG_POUCH_GATEWAY_CLOUD */
@@ -181,12 +185,10 @@ static void bt_connected(struct bt_conn *conn, uint8_t err)
 
         bt_conn_unref(conn);
 
-        pouch_gateway_scan_start();
         return;
     }
 
     LOG_INF("Connected: %s", addr);
-    default_conn = conn;
 
     err = bt_conn_set_security(conn, bt_security);
     if (err)
@@ -202,7 +204,10 @@ static void bt_disconnected(struct bt_conn *conn, uint8_t reason)
 {
     char addr[BT_ADDR_LE_STR_LEN];
 
-    default_conn = NULL;
+    if (pairing_conn == conn)
+    {
+        pairing_conn = NULL;
+    }
 
     bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
     LOG_INF("Disconnected: %s, reason 0x%02x %s", addr, reason, bt_hci_err_to_str(reason));
@@ -210,8 +215,6 @@ static void bt_disconnected(struct bt_conn *conn, uint8_t reason)
     pouch_gateway_bt_stop(conn);
 
     bt_conn_unref(conn);
-
-    pouch_gateway_scan_start();
 }
 
 static void security_changed(struct bt_conn *conn, bt_security_t level, enum bt_security_err err)
@@ -250,6 +253,11 @@ static void auth_cancel(struct bt_conn *conn)
     bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
 
     LOG_INF("Pairing cancelled: %s", addr);
+
+    if (pairing_conn == conn)
+    {
+        pairing_conn = NULL;
+    }
 }
 
 static void auth_passkey_confirm(struct bt_conn *conn, unsigned int passkey)
@@ -268,6 +276,10 @@ static void auth_passkey_confirm(struct bt_conn *conn, unsigned int passkey)
         LOG_INF("Confirming passkey");
         bt_conn_auth_passkey_confirm(conn);
     }
+    else
+    {
+        pairing_conn = conn;
+    }
 }
 
 static void auth_passkey_display(struct bt_conn *conn, unsigned int passkey)
@@ -346,11 +358,7 @@ int main(void)
         gpio_add_callback(button.port, &button_cb_data);
     }
 
-    connect_to_cloud();
-
-    pouch_gateway_cert_module_on_connected(client);
-    pouch_gateway_uplink_module_init(client);
-    pouch_gateway_downlink_module_init(client);
+    pouch_gateway_cert_module_init();
 
     err = bt_enable(NULL);
     if (err)
@@ -372,6 +380,14 @@ int main(void)
         pouch_gateway_bonding_enable(K_FOREVER);
     }
 
+    /* Node sessions need the client, but not its connection: nodes can
+       already be provisioned with a stored server certificate while the
+       client connects, and their uplinks are spooled if enabled */
+    connect_to_cloud();
+
+    pouch_gateway_uplink_module_init(client);
+    pouch_gateway_downlink_module_init(client);
+
     pouch_gateway_scan_start();
 
 #ifdef CONFIG_POUCH_GATEWAY_CLOUD
@@ -379,6 +395,9 @@ int main(void)
     {
         k_sem_take(&connected, K_FOREVER);
         pouch_gateway_cert_module_on_connected(client);
+#ifdef CONFIG_POUCH_GATEWAY_SPOOL
+        pouch_gateway_uplink_spool_drain();
+#endif
     }
 #endif
 
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/** Connection parameter profiles used during a node session */
+enum pouch_gateway_link_profile
+{
+    /** Short connection interval, while data is transferred */
+    POUCH_GATEWAY_LINK_PROFILE_BULK,
+    /** Relaxed connection interval, while waiting for the cloud */
+    POUCH_GATEWAY_LINK_PROFILE_IDLE,
+
+    POUCH_GATEWAY_LINK_PROFILES,
+};
+
+/** PHYs nodes are connected on */
+enum pouch_gateway_link_phy
+{
+    /** LE 1M PHY, which may be upgraded to the 2M PHY once connected */
+    POUCH_GATEWAY_LINK_PHY_1M,
+    /** LE Coded PHY, for nodes out of 1M range */
+    POUCH_GATEWAY_LINK_PHY_CODED,
+
+    POUCH_GATEWAY_LINK_PHYS,
+};
+
+/** Connections and traffic of node sessions on one PHY */
+struct pouch_gateway_link_phy_stats
+{
+    /** Number of connection attempts */
+    uint32_t attempts;
+    /** Number of connection attempts that succeeded */
+    uint32_t connected;
+    /** Number of payload bytes transferred */
+    uint64_t bytes;
+    /** Time in milliseconds spent in sessions */
+    uint64_t time_ms;
+};
+
+/** Traffic of all node sessions, per connection parameter profile */
+struct pouch_gateway_link_stats
+{
+    /** Number of payload bytes transferred while in each profile */
+    uint64_t bytes[POUCH_GATEWAY_LINK_PROFILES];
+    /** Time in milliseconds spent in each profile */
+    uint64_t time_ms[POUCH_GATEWAY_LINK_PROFILES];
+    /** Connections and traffic per PHY the node was connected on */
+    struct pouch_gateway_link_phy_stats phy[POUCH_GATEWAY_LINK_PHYS];
+};
+
+/**
+ * Get the traffic of all finished node sessions, per connection parameter profile and per PHY.
+ *
+ * Throughput of a profile or PHY is the number of bytes divided by the time spent in it. All
+ * values are zero unless CONFIG_POUCH_GATEWAY_GATT_LINK is enabled.
+ *
+ * @param[out] stats Traffic per profile and PHY.
+ */
+void pouch_gateway_link_stats_get(struct pouch_gateway_link_stats *stats);
@@ -6,6 +6,47 @@
 
 #pragma once
 
+#include <stdint.h>
+
+/** Scan interval and window profiles */
+enum pouch_gateway_scan_profile
+{
+    /** Scan most of the time, while no node is connected */
+    POUCH_GATEWAY_SCAN_PROFILE_FAST,
+    /** Share the radio with a few connections */
+    POUCH_GATEWAY_SCAN_PROFILE_BALANCED,
+    /** Leave most of the radio time to busy connections */
+    POUCH_GATEWAY_SCAN_PROFILE_LOW,
+
+    POUCH_GATEWAY_SCAN_PROFILES,
+};
+
+/** Traffic of node sessions while a scan profile was in effect */
+struct pouch_gateway_scan_profile_stats
+{
+    /** Time in milliseconds the profile was in effect */
+    uint64_t time_ms;
+    /** Sum of the time in milliseconds each connected node spent in the profile */
+    uint64_t session_time_ms;
+    /** Number of payload bytes transferred by all nodes */
+    uint64_t bytes;
+};
+
+/** Advertising report counters of the scan */
+struct pouch_gateway_scan_stats
+{
+    /** Number of advertising reports received */
+    uint32_t seen;
+    /** Number of reports identical to a recent one, which were not parsed again */
+    uint32_t deduped;
+    /** Number of reports that were parsed */
+    uint32_t processed;
+    /** Session traffic while scanning with each profile */
+    struct pouch_gateway_scan_profile_stats profile[POUCH_GATEWAY_SCAN_PROFILES];
+    /** Session traffic while scanning was paused */
+    struct pouch_gateway_scan_profile_stats paused;
+};
+
 /**
  * Start Bluetooth scanning for devices.
  *
@@ -13,5 +54,33 @@
  * 89a316ae-89b7-4ef6-b1d3-5c9a6e27d272 for backward compatibility) with vendor data indicating:
  * - compatible 'version'
  * - sync request set in 'flags'
+ *
+ * Scanning is paused only while a connection is being established and is resumed
+ * automatically afterwards, so that up to CONFIG_BT_MAX_CONN nodes can be served
+ * concurrently.
  */
 void pouch_gateway_scan_start(void);
+
+/**
+ * Get the advertising report counters of the scan.
+ *
+ * Reports of non-connectable advertisements are counted as seen, but neither deduped nor
+ * processed.
+ *
+ * The per node throughput of a profile is its number of bytes divided by its session time. The
+ * throughput lost to scanning is the difference to the per node throughput while scanning was
+ * paused. Bytes are only counted with CONFIG_POUCH_GATEWAY_GATT_LINK.
+ *
+ * @param[out] stats Report counters.
+ */
+void pouch_gateway_scan_stats_get(struct pouch_gateway_scan_stats *stats);
+
+/**
+ * Select the scan interval and window profile.
+ *
+ * Scanning is restarted with the new profile if it is running. The profile is selected
+ * automatically with CONFIG_POUCH_GATEWAY_GATT_SCAN_ADAPTIVE, in which case this does nothing.
+ *
+ * @param profile The scan profile.
+ */
+void pouch_gateway_scan_profile_set(enum pouch_gateway_scan_profile profile);
@@ -12,12 +12,32 @@ struct pouch_gateway_server_cert_context;
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 /* Max serial number length is 20 bytes according to spec:
  * https://datatracker.ietf.org/doc/html/rfc5280#section-4.1.2.2
  */
 #define CERT_SERIAL_MAXLEN 20
 
+/**
+ * Device certificate upload completion callback.
+ *
+ * @param err 0 on success, negative on error.
+ * @param arg User argument passed to @ref pouch_gateway_device_cert_finish_async().
+ */
+typedef void (*pouch_gateway_device_cert_done_cb)(int err, void *arg);
+
+/** Device certificate upload cache statistics */
+struct pouch_gateway_device_cert_cache_stats
+{
+    /** Number of uploads skipped because the certificate was uploaded recently */
+    uint32_t hits;
+    /** Number of certificates that were not found in the cache */
+    uint32_t misses;
+    /** Number of certificates currently in the cache */
+    uint32_t entries;
+};
+
 /**
  * Start device certificate handling.
  *
@@ -47,11 +67,47 @@ void pouch_gateway_device_cert_abort(struct pouch_gateway_device_cert_context *c
 /**
  * Finish device certificate handling.
  *
+ * Uploads the device certificate to the cloud, unless the same certificate was uploaded
+ * recently and CONFIG_POUCH_GATEWAY_DEVICE_CERT_CACHE is enabled.
+ *
  * @param context The device certificate context.
  * @return 0 on success, negative on error.
  */
 int pouch_gateway_device_cert_finish(struct pouch_gateway_device_cert_context *context);
 
+/**
+ * Finish device certificate handling asynchronously.
+ *
+ * Like @ref pouch_gateway_device_cert_finish(), but the upload runs on a dedicated work queue.
+ * The context is owned by the module once this returns 0, and is freed after @p done_cb is
+ * called from the work queue thread.
+ *
+ * @param context The device certificate context.
+ * @param done_cb Called when the upload completes.
+ * @param done_cb_arg User argument for @p done_cb.
+ * @return 0 if the upload was queued, negative on error.
+ */
+int pouch_gateway_device_cert_finish_async(struct pouch_gateway_device_cert_context *context,
+                                           pouch_gateway_device_cert_done_cb done_cb,
+                                           void *done_cb_arg);
+
+/**
+ * Get device certificate upload cache statistics.
+ *
+ * All statistics are zero without CONFIG_POUCH_GATEWAY_DEVICE_CERT_CACHE.
+ *
+ * @param[out] stats Cache statistics.
+ */
+#ifdef CONFIG_POUCH_GATEWAY_DEVICE_CERT_CACHE
+void pouch_gateway_device_cert_cache_stats_get(struct pouch_gateway_device_cert_cache_stats *stats);
+#else
+static inline void pouch_gateway_device_cert_cache_stats_get(
+    struct pouch_gateway_device_cert_cache_stats *stats)
+{
+    *stats = (struct pouch_gateway_device_cert_cache_stats) {0};
+}
+#endif
+
 /**
  * Start server certificate handling.
  *
@@ -104,9 +160,21 @@ int pouch_gateway_server_cert_get_data(struct pouch_gateway_server_cert_context
  */
 void pouch_gateway_server_cert_get_serial(void *dst, size_t *dst_len);
 
+/**
+ * Initialize the certificate module.
+ *
+ * Loads the server certificate stored by a previous refresh, so that nodes can be provisioned
+ * before the gateway connects to the cloud, and the device certificate upload cache. Must be
+ * called before any node connects.
+ */
+void pouch_gateway_cert_module_init(void);
+
 /**
  * Callback when connected to Golioth client for certificate module.
  *
+ * Downloads the server certificate. The current certificate is only replaced, and persisted
+ * when CONFIG_POUCH_GATEWAY_SERVER_CERT_PERSIST is enabled, if the serial number changed.
+ *
  * @param client The Golioth client.
  */
 void pouch_gateway_cert_module_on_connected(struct golioth_client *client);
@@ -6,11 +6,26 @@
 
 #pragma once
 
+#include <stdint.h>
 #include <golioth/client.h>
 
 struct pouch_gateway_downlink_context;
+struct pouch_gateway_downlink_block;
 typedef void (*pouch_gateway_downlink_data_available_cb)(void *);
 
+/** Block pool usage of a downlink context */
+struct pouch_gateway_downlink_stats
+{
+    /** Number of blocks currently held */
+    uint32_t blocks_used;
+    /** Highest number of blocks held at the same time */
+    uint32_t blocks_peak;
+    /** Number of blocks allocated over the lifetime of the context */
+    uint32_t blocks_total;
+    /** Number of blocks from the cloud refused because the context was out of quota */
+    uint32_t blocks_refused;
+};
+
 /**
  * Initialize the downlink module with the Golioth client.
  *
@@ -57,6 +72,77 @@ int pouch_gateway_downlink_get_data(struct pouch_gateway_downlink_context *downl
                                     size_t *dst_len,
                                     bool *is_last);
 
+/**
+ * Borrow the next contiguous chunk of downlink data.
+ *
+ * Provides direct access to the downlink data of the current block, without copying it. The
+ * borrowed data stays valid until it is released with @ref pouch_gateway_downlink_release().
+ * When no data is available, the data available callback is called once the cloud provides more.
+ *
+ * @param downlink The downlink context.
+ * @param[out] data Set to the start of the borrowed data, or NULL if there is none.
+ * @param[out] len Set to the number of bytes available at @p data.
+ * @param[out] is_last Set to true if the borrowed data is the end of the downlink.
+ * @return 0 on success, -EAGAIN if no data is available yet, -ENODATA if the downlink is
+ *         complete, -EIO if the cloud ended the downlink with an error.
+ */
+int pouch_gateway_downlink_borrow(struct pouch_gateway_downlink_context *downlink,
+                                  const void **data,
+                                  size_t *len,
+                                  bool *is_last);
+
+/**
+ * Release downlink data obtained with @ref pouch_gateway_downlink_borrow().
+ *
+ * @param downlink The downlink context.
+ * @param len The number of bytes consumed, at most the borrowed length.
+ * @return 0 on success, -EINVAL if @p len is more than was borrowed.
+ */
+int pouch_gateway_downlink_release(struct pouch_gateway_downlink_context *downlink, size_t len);
+
+/**
+ * Check whether downlink data can be borrowed without waiting for the cloud.
+ *
+ * Lets a transport that already holds some data stop asking for more, rather than have
+ * @ref pouch_gateway_downlink_borrow() arm the data available callback.
+ *
+ * @param downlink The downlink context.
+ * @return true if data, or the end of the downlink, is available.
+ */
+bool pouch_gateway_downlink_data_ready(struct pouch_gateway_downlink_context *downlink);
+
+/**
+ * Take the next downlink block out of the context, to send it without copying.
+ *
+ * Only a whole block that nothing has been borrowed from yet, and that is at most @p max_len
+ * bytes long, is taken. The transport may write the CONFIG_POUCH_GATEWAY_BLOCK_HEADROOM bytes
+ * in front of @p data. The block no longer counts against the context, and must be returned
+ * with @ref pouch_gateway_downlink_block_put() once it has been sent, which may be after the
+ * context was closed.
+ *
+ * @param downlink The downlink context.
+ * @param max_len The largest block the transport can send in place.
+ * @param[out] block Set to the block taken.
+ * @param[out] data Set to the start of the block data.
+ * @param[out] len Set to the length of the block data.
+ * @param[out] is_last Set to true if the block is the end of the downlink.
+ * @return 0 on success, -EMSGSIZE if the data must be borrowed instead, or an error of
+ *         @ref pouch_gateway_downlink_borrow().
+ */
+int pouch_gateway_downlink_block_take(struct pouch_gateway_downlink_context *downlink,
+                                      size_t max_len,
+                                      struct pouch_gateway_downlink_block **block,
+                                      uint8_t **data,
+                                      size_t *len,
+                                      bool *is_last);
+
+/**
+ * Return a block taken with @ref pouch_gateway_downlink_block_take() to the pool.
+ *
+ * @param block The downlink block.
+ */
+void pouch_gateway_downlink_block_put(struct pouch_gateway_downlink_block *block);
+
 /**
  * Check if the downlink is complete.
  *
@@ -79,6 +165,16 @@ enum golioth_status pouch_gateway_downlink_block_cb(const uint8_t *data,
                                                     bool is_last,
                                                     void *arg);
 
+/**
+ * End the downlink without any more data from the cloud.
+ *
+ * For downlinks that are not received from the cloud, so that the transport completes the
+ * downlink once it has sent the data queued so far.
+ *
+ * @param downlink The downlink context.
+ */
+void pouch_gateway_downlink_finish(struct pouch_gateway_downlink_context *downlink);
+
 /**
  * End callback for downlink.
  *
@@ -89,3 +185,12 @@ enum golioth_status pouch_gateway_downlink_block_cb(const uint8_t *data,
 void pouch_gateway_downlink_end_cb(enum golioth_status status,
                                    const struct golioth_coap_rsp_code *coap_rsp_code,
                                    void *arg);
+
+/**
+ * Get block pool usage statistics of a downlink context.
+ *
+ * @param downlink The downlink context.
+ * @param[out] stats Block pool usage of the downlink context.
+ */
+void pouch_gateway_downlink_stats_get(const struct pouch_gateway_downlink_context *downlink,
+                                      struct pouch_gateway_downlink_stats *stats);
@@ -41,8 +41,10 @@ void pouch_gateway_info_abort(struct pouch_gateway_info_context *context);
  * @param context The info context.
  * @param[out] server_cert_provisioned Set to true if server cert is provisioned.
  * @param[out] device_cert_provisioned Set to true if device cert is provisioned.
+ * @param[out] l2cap_coc_supported Set to true if the node accepts an L2CAP channel for pouch data.
  * @return 0 on success, negative on error.
  */
 int pouch_gateway_info_finish(struct pouch_gateway_info_context *context,
                               bool *server_cert_provisioned,
-                              bool *device_cert_provisioned);
+                              bool *device_cert_provisioned,
+                              bool *l2cap_coc_supported);
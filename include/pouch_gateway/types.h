@@ -9,8 +9,14 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <zephyr/bluetooth/gatt.h>
+#include <zephyr/bluetooth/l2cap.h>
+#include <zephyr/kernel.h>
+
+#include <pouch_gateway/bt/link.h>
 
 #define POUCH_GATEWAY_BT_ATT_OVERHEAD 3 /* opcode (1) + handle (2) */
+#define POUCH_GATEWAY_UPLINK_ACK_MAX_LEN 8
+#define POUCH_GATEWAY_BT_DB_HASH_LEN 16 /* GATT Database Hash characteristic */
 
 enum pouch_gateway_gatt_attr
 {
@@ -25,7 +31,7 @@ enum pouch_gateway_gatt_attr
 
 enum server_cert_next_state
 {
-    SERVER_CERT_NEXT_DEVICE_CERT,
+    SERVER_CERT_NEXT_DONE,
     SERVER_CERT_NEXT_SERVER_CERT,
     SERVER_CERT_NEXT_END
 };
@@ -38,7 +44,21 @@ struct pouch_gateway_attr_handle
 
 struct pouch_gateway_node_info
 {
+    struct bt_conn *conn;
+    int64_t connected_at;
+    enum pouch_gateway_link_phy link_phy;
+    enum pouch_gateway_link_profile link_profile;
+    int64_t link_profile_since;
+    uint64_t link_bytes[POUCH_GATEWAY_LINK_PROFILES];
+    int64_t link_time_ms[POUCH_GATEWAY_LINK_PROFILES];
+    atomic_t pending_phases;
     struct pouch_gateway_attr_handle attr_handles[POUCH_GATEWAY_GATT_ATTRS];
+    bool attr_handles_cached;
+    uint8_t db_hash[POUCH_GATEWAY_BT_DB_HASH_LEN];
+    bool db_hash_valid;
+    struct bt_gatt_read_params db_hash_read_params;
+    struct k_work handle_cache_load_work;
+    struct k_work handle_cache_store_work;
     struct bt_gatt_discover_params discover_params;
     struct bt_gatt_subscribe_params info_subscribe_params;
     struct bt_gatt_subscribe_params server_cert_subscribe_params;
@@ -52,11 +72,31 @@ struct pouch_gateway_node_info
     struct pouch_gatt_sender *downlink_sender;
     struct pouch_gatt_receiver *uplink_receiver;
     struct pouch_gatt_packetizer *packetizer;
+    struct pouch_gatt_packetizer *server_cert_packetizer;
     struct pouch_gateway_uplink *uplink;
+    struct k_work uplink_ack_work;
+    uint8_t uplink_deferred_ack[POUCH_GATEWAY_UPLINK_ACK_MAX_LEN];
+    size_t uplink_deferred_ack_len;
+    size_t uplink_window_len;
     struct pouch_gateway_info_context *info_ctx;
     struct pouch_gateway_device_cert_context *device_cert_ctx;
     struct pouch_gateway_server_cert_context *server_cert_ctx;
     enum server_cert_next_state server_cert_next;
     bool server_cert_provisioned;
     bool device_cert_provisioned;
+    bool l2cap_coc_supported;
+#ifdef CONFIG_POUCH_GATEWAY_L2CAP
+    struct bt_l2cap_le_chan l2cap_chan;
+    bool l2cap_connecting;
+    bool l2cap_connected;
+    bool l2cap_uplink_started;
+    bool l2cap_downlink_last;
+    atomic_t l2cap_tx_pending;
+    struct k_fifo l2cap_rx_queue;
+    struct k_work l2cap_rx_work;
+    struct k_work l2cap_tx_work;
+#endif /* CONFIG_POUCH_GATEWAY_L2CAP */
+    uint8_t gatt_window;
+    int64_t gatt_ack_sent_at;
+    uint32_t gatt_rtt_min;
 };
@@ -25,7 +25,40 @@ enum pouch_gateway_uplink_result
     POUCH_GATEWAY_UPLINK_ERROR_CLOUD,
 };
 
+/** Usage statistics of the shared uplink block pool */
+struct pouch_gateway_uplink_stats
+{
+    /** Number of blocks in the pool */
+    uint32_t blocks_total;
+    /** Number of blocks currently in use */
+    uint32_t blocks_used;
+    /** Highest number of blocks in use at the same time */
+    uint32_t blocks_peak;
+    /** Number of allocations that failed because the pool was empty */
+    uint32_t alloc_failures;
+};
+
+/** State of the store-and-forward spool */
+struct pouch_gateway_spool_stats
+{
+    /** Number of pouches currently in the spool */
+    uint32_t depth_files;
+    /** Number of bytes currently in the spool */
+    uint64_t depth_bytes;
+    /** Number of pouches written to the spool since boot */
+    uint32_t spooled_files;
+    /** Number of spooled pouches uploaded to the cloud since boot */
+    uint32_t drained_files;
+    /** Number of spooled bytes uploaded to the cloud since boot */
+    uint64_t drained_bytes;
+    /** Upload rate of the last drained pouch, in bytes per second */
+    uint32_t drain_rate;
+    /** Number of spooled pouches set aside since boot because they could not be read */
+    uint32_t quarantined_files;
+};
+
 typedef void (*pouch_gateway_uplink_end_cb)(void *arg, enum pouch_gateway_uplink_result res);
+typedef void (*pouch_gateway_uplink_writable_cb)(void *arg);
 
 /**
  * Write data to the uplink.
@@ -41,18 +74,83 @@ int pouch_gateway_uplink_write(struct pouch_gateway_uplink *uplink,
                                size_t len,
                                bool is_last);
 
+/**
+ * Reserve space in the current uplink block.
+ *
+ * Provides a pointer into the uplink's current block, so that the transport can place received
+ * data there directly instead of passing it to @ref pouch_gateway_uplink_write(). Data written
+ * to the buffer must be committed with @ref pouch_gateway_uplink_commit() before the next call
+ * to any other uplink write function.
+ *
+ * @param uplink The uplink context.
+ * @param[out] buf Set to the start of the reserved space.
+ * @param[out] len Set to the number of bytes available at @p buf.
+ * @return 0 on success, -ENOMEM if no block is available.
+ */
+int pouch_gateway_uplink_reserve(struct pouch_gateway_uplink *uplink, uint8_t **buf, size_t *len);
+
+/**
+ * Commit data written to space reserved with @ref pouch_gateway_uplink_reserve().
+ *
+ * @param uplink The uplink context.
+ * @param len The number of bytes written, at most the reserved length.
+ * @param is_last true if this is the last chunk.
+ * @return 0 on success, -EINVAL if more data is committed than was reserved.
+ */
+int pouch_gateway_uplink_commit(struct pouch_gateway_uplink *uplink, size_t len, bool is_last);
+
+/**
+ * Check if the uplink can accept more data.
+ *
+ * The uplink is congested once it has reached its high watermark, or when the block pool cannot
+ * hold another @p len bytes for it. Otherwise the blocks for @p len bytes are set aside, so
+ * data the transport accepts after this check always fits.
+ *
+ * While congested, the transport should stop accepting new data from the node. Once queued
+ * blocks have been delivered to the cloud, or blocks were returned to the pool, the writable
+ * callback passed to @ref pouch_gateway_uplink_open() is called.
+ *
+ * @param uplink The uplink context.
+ * @param len Number of bytes the transport lets the node send when not congested.
+ * @return true if the uplink is congested, false otherwise.
+ */
+bool pouch_gateway_uplink_is_congested(struct pouch_gateway_uplink *uplink, size_t len);
+
 /**
  * Open an uplink for the given downlink context.
  *
  * The uplink must be closed by a call to @ref pouch_gateway_uplink_close().
  *
- * @param downlink The downlink context.
+ * @param downlink The downlink context, or NULL to discard the cloud response.
+ * @param end_cb Callback for when the uplink ends.
+ * @param writable_cb Callback for when a congested uplink can accept data again. May be NULL.
+ * @param end_cb_arg Argument for the callbacks.
  * @return Pointer to the uplink context.
  */
 struct pouch_gateway_uplink *pouch_gateway_uplink_open(
     struct pouch_gateway_downlink_context *downlink,
     pouch_gateway_uplink_end_cb end_cb,
-    void *failed_cb_arg);
+    pouch_gateway_uplink_writable_cb writable_cb,
+    void *end_cb_arg);
+
+/**
+ * Open an uplink to the cloud, never to the spool.
+ *
+ * Like @ref pouch_gateway_uplink_open(), but fails while the cloud is unavailable instead of
+ * spooling the pouch. Used for uplinks that may never carry data, which are not worth a spool
+ * file.
+ *
+ * @param downlink The downlink context, or NULL to discard the cloud response.
+ * @param end_cb Callback for when the uplink ends.
+ * @param writable_cb Callback for when a congested uplink can accept data again. May be NULL.
+ * @param end_cb_arg Argument for the callbacks.
+ * @return Pointer to the uplink context, or NULL if the cloud is unavailable.
+ */
+struct pouch_gateway_uplink *pouch_gateway_uplink_open_cloud(
+    struct pouch_gateway_downlink_context *downlink,
+    pouch_gateway_uplink_end_cb end_cb,
+    pouch_gateway_uplink_writable_cb writable_cb,
+    void *end_cb_arg);
 
 /**
  * Close the uplink.
@@ -61,9 +159,59 @@ struct pouch_gateway_uplink *pouch_gateway_uplink_open(
  */
 void pouch_gateway_uplink_close(struct pouch_gateway_uplink *uplink);
 
+/**
+ * Discard an uplink that has not carried any data.
+ *
+ * Allows opening an uplink speculatively, before it is known whether it will be used. Nothing
+ * is sent to the cloud, and the end callback is not called. The downlink context passed to
+ * @ref pouch_gateway_uplink_open() is not used by the cloud afterwards and may be closed.
+ *
+ * @param uplink The uplink context.
+ * @return 0 if the uplink was discarded, -EBUSY if data was already written to it, in which
+ * case it must be closed with @ref pouch_gateway_uplink_close().
+ */
+int pouch_gateway_uplink_discard(struct pouch_gateway_uplink *uplink);
+
+/**
+ * Abort an uplink that cannot be completed.
+ *
+ * The pouch is not finished, so the cloud drops the data it has received so far. The end
+ * callback is called with POUCH_GATEWAY_UPLINK_ERROR_LOCAL, unless the uplink has already
+ * failed. As after @ref pouch_gateway_uplink_close(), the uplink must not be used afterwards.
+ *
+ * @param uplink The uplink context.
+ */
+void pouch_gateway_uplink_abort(struct pouch_gateway_uplink *uplink);
+
 /**
  * Initialize the uplink module with the Golioth client.
  *
  * @param c The Golioth client.
  */
 void pouch_gateway_uplink_module_init(struct golioth_client *c);
+
+/**
+ * Get usage statistics of the uplink block pool.
+ *
+ * @param[out] stats Statistics of the uplink block pool.
+ */
+void pouch_gateway_uplink_stats_get(struct pouch_gateway_uplink_stats *stats);
+
+/**
+ * Upload spooled pouches to the cloud.
+ *
+ * Should be called when the gateway connects to the cloud. Draining runs in the background,
+ * and stops when the spool is empty or an upload fails. Only available when
+ * CONFIG_POUCH_GATEWAY_SPOOL is enabled.
+ */
+void pouch_gateway_uplink_spool_drain(void);
+
+/**
+ * Get the state of the store-and-forward spool.
+ *
+ * The spool is scanned in the background once the file system is available, and reads as
+ * empty until then.
+ *
+ * @param[out] stats Spool depth and drain statistics.
+ */
+void pouch_gateway_uplink_spool_stats_get(struct pouch_gateway_spool_stats *stats);
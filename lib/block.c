@@ -29,9 +29,13 @@ struct block
         uint8_t is_last : 1;
     } flags;
     size_t len;
-    uint8_t data[CONFIG_GOLIOTH_BLOCKWISE_UPLOAD_MAX_BLOCK_SIZE];
+    /* The headroom is kept right in front of the data */
+    uint8_t buf[CONFIG_POUCH_GATEWAY_BLOCK_HEADROOM
+                + CONFIG_GOLIOTH_BLOCKWISE_UPLOAD_MAX_BLOCK_SIZE];
 };
 
+#define BLOCK_DATA(block) (&(block)->buf[CONFIG_POUCH_GATEWAY_BLOCK_HEADROOM])
+
 K_MEM_SLAB_DEFINE_STATIC(block_slab, sizeof(struct block), CONFIG_POUCH_GATEWAY_NUM_BLOCKS, 4);
 
 struct block *block_alloc(void *user_data, k_timeout_t timeout)
@@ -58,6 +62,16 @@ size_t block_length(const struct block *block)
     return block->len;
 }
 
+const uint8_t *block_data(const struct block *block)
+{
+    return BLOCK_DATA(block);
+}
+
+uint8_t *block_headroom(struct block *block)
+{
+    return block->buf;
+}
+
 void block_mark_last(struct block *block)
 {
     block->flags.is_last = true;
@@ -70,7 +84,7 @@ bool block_is_last(const struct block *block)
 
 void block_append(struct block *block, const void *data, size_t data_len)
 {
-    memcpy(block->data + block->len, data, data_len);
+    memcpy(BLOCK_DATA(block) + block->len, data, data_len);
     block->len += data_len;
 }
 
@@ -81,7 +95,7 @@ int block_get(const struct block *block, size_t offset, void *buf, size_t len)
         return -EINVAL;
     }
 
-    memcpy(buf, block->data + offset, len);
+    memcpy(buf, BLOCK_DATA(block) + offset, len);
 
     return 0;
 }
@@ -7,6 +7,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <zephyr/kernel.h>
 
@@ -15,6 +16,8 @@ struct block;
 struct block *block_alloc(void *user_data, k_timeout_t timeout);
 void block_free(struct block *block);
 size_t block_length(const struct block *block);
+const uint8_t *block_data(const struct block *block);
+uint8_t *block_headroom(struct block *block);
 void block_mark_last(struct block *block);
 bool block_is_last(const struct block *block);
 void block_append(struct block *block, const void *data, size_t data_len);
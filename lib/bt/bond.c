@@ -6,6 +6,8 @@
 
 #include <pouch_gateway/bt/bond.h>
 
+#include "scan.h"
+
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(bond, CONFIG_POUCH_GATEWAY_GATT_LOG_LEVEL);
 
@@ -16,6 +18,7 @@ static void pouch_gateway_bonding_timeout_handle(struct k_work *work)
     if (atomic_set(&pouch_gateway_bonding, 0))
     {
         LOG_INF("Bonding disabled on timeout");
+        pouch_gateway_scan_update();
     }
 }
 
@@ -26,6 +29,7 @@ void pouch_gateway_bonding_enable(k_timeout_t timeout)
     if (!atomic_set(&pouch_gateway_bonding, 1))
     {
         LOG_INF("Bonding enabled");
+        pouch_gateway_scan_update();
     }
     k_work_reschedule(&pouch_gateway_bonding_timeout_work, timeout);
 }
@@ -36,6 +40,7 @@ void pouch_gateway_bonding_disable(void)
     if (atomic_set(&pouch_gateway_bonding, 0))
     {
         LOG_INF("Bonding disabled");
+        pouch_gateway_scan_update();
     }
 }
 
@@ -17,9 +17,14 @@
 #include <pouch_gateway/bt/connect.h>
 #include <pouch_gateway/bt/scan.h>
 
+#include "connect.h"
 #include "downlink.h"
+#include "handle_cache.h"
 #include "info.h"
+#include "l2cap.h"
+#include "link.h"
 #include "uplink.h"
+#include "window.h"
 
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(connect, CONFIG_POUCH_GATEWAY_GATT_LOG_LEVEL);
@@ -41,6 +46,23 @@ BUILD_ASSERT(ARRAY_SIZE(char_uuids) == POUCH_GATEWAY_GATT_ATTRS,
 
 static struct pouch_gateway_node_info connected_nodes[CONFIG_BT_MAX_CONN];
 
+static void discovery_complete(struct bt_conn *conn)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+
+    if (node->attr_handles[POUCH_GATEWAY_GATT_ATTR_SERVER_CERT].value
+        && node->attr_handles[POUCH_GATEWAY_GATT_ATTR_DEVICE_CERT].value)
+    {
+        pouch_gateway_info_read_start(conn);
+    }
+    else
+    {
+        LOG_WRN("Could not discover %s characteristics", "certificate");
+        LOG_INF("Starting uplink without cert exchange");
+        pouch_gateway_uplink_start(conn);
+    }
+}
+
 static uint8_t discover_descriptors(struct bt_conn *conn,
                                     const struct bt_gatt_attr *attr,
                                     struct bt_gatt_discover_params *params)
@@ -77,18 +99,14 @@ static uint8_t discover_descriptors(struct bt_conn *conn,
         return BT_GATT_ITER_CONTINUE;
     }
 
-    if (node->attr_handles[POUCH_GATEWAY_GATT_ATTR_SERVER_CERT].value
-        && node->attr_handles[POUCH_GATEWAY_GATT_ATTR_DEVICE_CERT].value)
-    {
-        pouch_gateway_info_read_start(conn);
-    }
-    else
+    /* Handles can only be reused while the database hash matches */
+    if (IS_ENABLED(CONFIG_POUCH_GATEWAY_GATT_HANDLE_CACHE) && node->db_hash_valid)
     {
-        LOG_WRN("Could not discover %s characteristics", "certificate");
-        LOG_INF("Starting uplink without cert exchange");
-        pouch_gateway_uplink_start(conn);
+        k_work_submit(&node->handle_cache_store_work);
     }
 
+    discovery_complete(conn);
+
     return BT_GATT_ITER_STOP;
 }
 
@@ -197,14 +215,12 @@ static uint8_t discover_services(struct bt_conn *conn,
     return BT_GATT_ITER_CONTINUE;
 }
 
-void pouch_gateway_bt_start(struct bt_conn *conn)
+static void discover_start(struct bt_conn *conn)
 {
     int err;
 
-    uint8_t conn_idx = bt_conn_index(conn);
-    memset(&connected_nodes[conn_idx], 0, sizeof(connected_nodes[conn_idx]));
-
-    struct bt_gatt_discover_params *discover_params = &connected_nodes[conn_idx].discover_params;
+    struct bt_gatt_discover_params *discover_params =
+        &pouch_gateway_get_node_info(conn)->discover_params;
 
     discover_params->func = discover_services;
     discover_params->type = BT_GATT_DISCOVER_PRIMARY;
@@ -220,10 +236,155 @@ void pouch_gateway_bt_start(struct bt_conn *conn)
     }
 }
 
+bool pouch_gateway_bt_cached_handles_failed(struct bt_conn *conn)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+
+    if (!node->attr_handles_cached)
+    {
+        return false;
+    }
+
+    LOG_WRN("Cached handles are stale, rediscovering");
+
+    pouch_gateway_handle_cache_delete(bt_conn_get_dst(conn));
+
+    node->attr_handles_cached = false;
+    memset(node->attr_handles, 0, sizeof(node->attr_handles));
+
+    discover_start(conn);
+
+    return true;
+}
+
+static void handle_cache_load_work_handler(struct k_work *work)
+{
+    struct pouch_gateway_node_info *node =
+        CONTAINER_OF(work, struct pouch_gateway_node_info, handle_cache_load_work);
+    struct bt_conn *conn = node->conn;
+    int err = -ENOENT;
+
+    if (node->db_hash_valid)
+    {
+        err = pouch_gateway_handle_cache_load(bt_conn_get_dst(conn),
+                                              node->db_hash,
+                                              node->attr_handles);
+    }
+
+    if (0 == err)
+    {
+        LOG_DBG("Using cached handles");
+        node->attr_handles_cached = true;
+        discovery_complete(conn);
+        return;
+    }
+
+    if (-ESTALE == err)
+    {
+        LOG_INF("Database hash changed, rediscovering");
+    }
+
+    discover_start(conn);
+}
+
+static void handle_cache_store_work_handler(struct k_work *work)
+{
+    struct pouch_gateway_node_info *node =
+        CONTAINER_OF(work, struct pouch_gateway_node_info, handle_cache_store_work);
+
+    pouch_gateway_handle_cache_store(bt_conn_get_dst(node->conn),
+                                     node->db_hash,
+                                     node->attr_handles);
+}
+
+static uint8_t db_hash_read_cb(struct bt_conn *conn,
+                               uint8_t err,
+                               struct bt_gatt_read_params *params,
+                               const void *data,
+                               uint16_t length)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+
+    if (0 == err && NULL != data && sizeof(node->db_hash) == length)
+    {
+        memcpy(node->db_hash, data, length);
+        node->db_hash_valid = true;
+    }
+    else
+    {
+        /* Without a database hash the cache cannot be validated */
+        LOG_DBG("No database hash: %d", err);
+    }
+
+    /* Settings are read off the Bluetooth receive thread */
+    k_work_submit(&node->handle_cache_load_work);
+
+    return BT_GATT_ITER_STOP;
+}
+
+static void db_hash_read_start(struct bt_conn *conn)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+    struct bt_gatt_read_params *params = &node->db_hash_read_params;
+
+    params->func = db_hash_read_cb;
+    params->handle_count = 0;
+    params->by_uuid.start_handle = BT_ATT_FIRST_ATTRIBUTE_HANDLE;
+    params->by_uuid.end_handle = BT_ATT_LAST_ATTRIBUTE_HANDLE;
+    params->by_uuid.uuid = BT_UUID_GATT_DB_HASH;
+
+    int err = bt_gatt_read(conn, params);
+    if (err)
+    {
+        LOG_WRN("Failed to read database hash: %d", err);
+        discover_start(conn);
+    }
+}
+
+void pouch_gateway_bt_start(struct bt_conn *conn)
+{
+    uint8_t conn_idx = bt_conn_index(conn);
+    struct pouch_gateway_node_info *node = &connected_nodes[conn_idx];
+
+    memset(node, 0, sizeof(*node));
+    node->conn = conn;
+    node->connected_at = k_uptime_get();
+
+    pouch_gateway_link_session_start(conn);
+
+    /* Open the cloud session while GATT discovery is in progress */
+    pouch_gateway_uplink_prepare(conn);
+
+    /* Only bonded nodes are cached, identified by their identity address */
+    if (IS_ENABLED(CONFIG_POUCH_GATEWAY_GATT_HANDLE_CACHE)
+        && bt_le_bond_exists(BT_ID_DEFAULT, bt_conn_get_dst(conn)))
+    {
+        k_work_init(&node->handle_cache_load_work, handle_cache_load_work_handler);
+        k_work_init(&node->handle_cache_store_work, handle_cache_store_work_handler);
+        db_hash_read_start(conn);
+        return;
+    }
+
+    discover_start(conn);
+}
+
 void pouch_gateway_bt_stop(struct bt_conn *conn)
 {
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+
+    if (node->handle_cache_load_work.handler != NULL)
+    {
+        struct k_work_sync sync;
+
+        k_work_cancel_sync(&node->handle_cache_load_work, &sync);
+        k_work_cancel_sync(&node->handle_cache_store_work, &sync);
+    }
+
+    pouch_gateway_window_save(conn);
+    pouch_gateway_l2cap_cleanup(conn);
     pouch_gateway_uplink_cleanup(conn);
     pouch_gateway_downlink_cleanup(conn);
+    pouch_gateway_link_session_end(conn);
 }
 
 struct pouch_gateway_node_info *pouch_gateway_get_node_info(const struct bt_conn *conn)
@@ -0,0 +1,22 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+struct bt_conn;
+
+/**
+ * Handle a GATT operation failure that may be caused by stale cached attribute handles.
+ *
+ * If the handles of the connection were loaded from the handle cache, the cache entry is
+ * dropped and service discovery is restarted.
+ *
+ * @param conn The Bluetooth connection.
+ * @return true if discovery was restarted, false if the handles were not cached.
+ */
+bool pouch_gateway_bt_cached_handles_failed(struct bt_conn *conn);
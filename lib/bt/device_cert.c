@@ -18,7 +18,9 @@
 #include <pouch_gateway/cert.h>
 
 #include "cert.h"
-#include "uplink.h"
+#include "link.h"
+#include "session.h"
+#include "window.h"
 
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(device_cert_gatt, CONFIG_POUCH_GATEWAY_GATT_LOG_LEVEL);
@@ -40,6 +42,20 @@ static void device_cert_cleanup(struct bt_conn *conn)
     }
 }
 
+static void device_cert_uploaded(int err, void *arg)
+{
+    struct bt_conn *conn = arg;
+
+    if (err)
+    {
+        /* The cloud cannot process the node's pouches without its certificate */
+        LOG_ERR("Failed to upload device cert: %d", err);
+        pouch_gateway_bt_finished(conn);
+    }
+
+    bt_conn_unref(conn);
+}
+
 static int device_cert_data_received_cb(void *conn,
                                         const void *data,
                                         size_t length,
@@ -48,6 +64,8 @@ static int device_cert_data_received_cb(void *conn,
 {
     struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
 
+    pouch_gateway_link_bytes(conn, length);
+
     int err = pouch_gateway_device_cert_push(node->device_cert_ctx, data, length);
     if (err)
     {
@@ -57,10 +75,14 @@ static int device_cert_data_received_cb(void *conn,
 
     if (is_last)
     {
-        err = pouch_gateway_device_cert_finish(node->device_cert_ctx);
+        /* Upload in the background, overlapped with the uplink */
+        err = pouch_gateway_device_cert_finish_async(node->device_cert_ctx,
+                                                     device_cert_uploaded,
+                                                     bt_conn_ref(conn));
         if (err)
         {
             LOG_ERR("Failed to finish device cert: %d", err);
+            bt_conn_unref(conn);
             goto finish;
         }
         node->device_cert_ctx = NULL;
@@ -81,6 +103,8 @@ static int send_ack_cb(void *conn, const void *data, size_t length)
     struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
     uint16_t handle = node->attr_handles[POUCH_GATEWAY_GATT_ATTR_DEVICE_CERT].value;
 
+    pouch_gateway_window_ack_sent(conn, data, length);
+
     return bt_gatt_write_without_response(conn, handle, data, length, false);
 }
 
@@ -117,6 +141,8 @@ static uint8_t device_cert_notify_cb(struct bt_conn *conn,
     }
 
     bool complete = false;
+    pouch_gateway_window_data_received(conn);
+
     int err = pouch_gatt_receiver_receive_data(node->device_cert_receiver, data, length, &complete);
     if (err)
     {
@@ -133,7 +159,7 @@ static uint8_t device_cert_notify_cb(struct bt_conn *conn,
     {
         device_cert_cleanup(conn);
 
-        pouch_gateway_uplink_start(conn);
+        pouch_gateway_session_phase_done(conn, POUCH_GATEWAY_SESSION_PHASE_DEVICE_CERT);
 
         return BT_GATT_ITER_STOP;
     }
@@ -150,7 +176,7 @@ void pouch_gateway_device_cert_read(struct bt_conn *conn)
 
     if (node->device_cert_provisioned)
     {
-        pouch_gateway_uplink_start(conn);
+        pouch_gateway_session_phase_done(conn, POUCH_GATEWAY_SESSION_PHASE_DEVICE_CERT);
         return;
     }
 
@@ -170,12 +196,13 @@ void pouch_gateway_device_cert_read(struct bt_conn *conn)
         return;
     }
 
-    node->device_cert_receiver =
-        pouch_gatt_receiver_create(send_ack_cb,
-                                   conn,
-                                   device_cert_data_received_cb,
-                                   conn,
-                                   CONFIG_POUCH_GATT_DEVICE_CERT_WINDOW_SIZE);
+    uint8_t window = pouch_gateway_window_size(conn, CONFIG_POUCH_GATT_DEVICE_CERT_WINDOW_SIZE);
+
+    node->device_cert_receiver = pouch_gatt_receiver_create(send_ack_cb,
+                                                            conn,
+                                                            device_cert_data_received_cb,
+                                                            conn,
+                                                            window);
     if (NULL == node->device_cert_receiver)
     {
         LOG_ERR("Failed to create receiver");
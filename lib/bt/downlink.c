@@ -5,6 +5,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/bluetooth/hci.h>
@@ -20,10 +21,20 @@
 #include <pouch_gateway/types.h>
 
 #include "downlink.h"
+#include "l2cap.h"
+#include "link.h"
 
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(downlink_gatt, CONFIG_POUCH_GATEWAY_GATT_LOG_LEVEL);
 
+BUILD_ASSERT(CONFIG_POUCH_GATEWAY_NUM_BLOCKS
+                 >= CONFIG_BT_MAX_CONN * CONFIG_POUCH_GATEWAY_DOWNLINK_MIN_BLOCKS,
+             "Downlink buffer too small to serve CONFIG_BT_MAX_CONN nodes");
+
+/* A downlink interrupted by a disconnect is dropped, along with the
+   blocks already fetched from the cloud. Resuming it would need the node
+   to continue a transfer from an offset, which the pouch transport has
+   no way to express, so the node gets the data with its next sync. */
 static void cleanup_downlink(const struct bt_conn *conn)
 {
     struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
@@ -47,37 +58,105 @@ static void cleanup_downlink(const struct bt_conn *conn)
     }
 }
 
+int pouch_gateway_downlink_fill(struct bt_conn *conn, void *dst, size_t *dst_len, bool *last)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+    size_t filled = 0;
+
+    *last = false;
+
+    /* Copy straight from the downlink blocks into the packet */
+    while (filled < *dst_len && !*last)
+    {
+        const void *data;
+        size_t len;
+
+        /* Send what the packet holds rather than wait for the cloud */
+        if (0 < filled && !pouch_gateway_downlink_data_ready(node->downlink_ctx))
+        {
+            break;
+        }
+
+        int ret = pouch_gateway_downlink_borrow(node->downlink_ctx, &data, &len, last);
+        if (-EAGAIN == ret)
+        {
+            LOG_DBG("Awaiting additional downlink data from cloud");
+
+            *dst_len = filled;
+            return -EAGAIN;
+        }
+        if (0 > ret)
+        {
+            LOG_ERR("Error getting downlink data: %d", ret);
+
+            *dst_len = 0;
+            return ret;
+        }
+
+        if (len > *dst_len - filled)
+        {
+            len = *dst_len - filled;
+            *last = false;
+        }
+
+        memcpy((uint8_t *) dst + filled, data, len);
+        filled += len;
+
+        ret = pouch_gateway_downlink_release(node->downlink_ctx, len);
+        if (ret)
+        {
+            LOG_ERR("Error releasing downlink data: %d", ret);
+
+            *dst_len = 0;
+            return ret;
+        }
+    }
+
+    *dst_len = filled;
+
+    return 0;
+}
+
 static enum pouch_gatt_packetizer_result downlink_packet_fill_cb(void *dst,
                                                                  size_t *dst_len,
                                                                  void *user_arg)
 {
-    bool last = false;
+    bool last;
 
-    int ret = pouch_gateway_downlink_get_data(user_arg, dst, dst_len, &last);
+    int ret = pouch_gateway_downlink_fill(user_arg, dst, dst_len, &last);
     if (-EAGAIN == ret)
     {
-        LOG_DBG("Awaiting additional downlink data from cloud");
-
         return POUCH_GATT_PACKETIZER_MORE_DATA;
     }
     if (0 > ret)
     {
-        LOG_ERR("Error getting downlink data: %d", ret);
-
-        *dst_len = 0;
         return POUCH_GATT_PACKETIZER_ERROR;
     }
 
     return last ? POUCH_GATT_PACKETIZER_NO_MORE_DATA : POUCH_GATT_PACKETIZER_MORE_DATA;
 }
 
+void pouch_gateway_downlink_complete(struct bt_conn *conn)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+
+    LOG_DBG("Downlink complete");
+
+    pouch_gateway_downlink_close(node->downlink_ctx);
+    node->downlink_ctx = NULL;
+}
+
 static int send_data_cb(void *conn, const void *data, size_t length)
 {
     struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
     uint16_t downlink_handle = node->attr_handles[POUCH_GATEWAY_GATT_ATTR_DOWNLINK].value;
 
     int err = bt_gatt_write_without_response(conn, downlink_handle, data, length, false);
-    if (err)
+    if (0 == err)
+    {
+        pouch_gateway_link_bytes(conn, length);
+    }
+    else
     {
         /* This error gets propagated to downlink_notify_cb via
            pouch_gatt_sender_receive_ack, so no cleanup required here */
@@ -140,10 +219,7 @@ static uint8_t downlink_notify_cb(struct bt_conn *conn,
 
     if (complete)
     {
-        LOG_DBG("Downlink complete");
-
-        pouch_gateway_downlink_close(node->downlink_ctx);
-        node->downlink_ctx = NULL;
+        pouch_gateway_downlink_complete(conn);
 
         return BT_GATT_ITER_STOP;
     }
@@ -151,14 +227,55 @@ static uint8_t downlink_notify_cb(struct bt_conn *conn,
     return BT_GATT_ITER_CONTINUE;
 }
 
+/* The sender is created once there is data to send, so that it uses the
+   MTU negotiated by then rather than the one at the start of the session */
+static int downlink_sender_create(struct bt_conn *conn)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+
+    size_t mtu = bt_gatt_get_mtu(conn);
+    if (mtu < POUCH_GATEWAY_BT_ATT_OVERHEAD)
+    {
+        LOG_ERR("MTU too small");
+        return -EINVAL;
+    }
+    mtu -= POUCH_GATEWAY_BT_ATT_OVERHEAD;
+
+    node->downlink_sender = pouch_gatt_sender_create(node->packetizer, send_data_cb, conn, mtu);
+    if (NULL == node->downlink_sender)
+    {
+        LOG_ERR("Failed to create sender");
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
 static void downlink_data_available(void *arg)
 {
     struct bt_conn *conn = arg;
 
     struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
 
+    if (pouch_gateway_l2cap_is_connected(conn))
+    {
+        pouch_gateway_link_profile_set(conn, POUCH_GATEWAY_LINK_PROFILE_BULK);
+        pouch_gateway_l2cap_downlink_kick(conn);
+        return;
+    }
+
     if (0 == node->downlink_subscribe_params.value)
     {
+        pouch_gateway_link_profile_set(conn, POUCH_GATEWAY_LINK_PROFILE_BULK);
+
+        if (downlink_sender_create(conn))
+        {
+            cleanup_downlink(conn);
+            pouch_gateway_bt_finished(conn);
+
+            return;
+        }
+
         struct bt_gatt_subscribe_params *subscribe_params = &node->downlink_subscribe_params;
         memset(subscribe_params, 0, sizeof(*subscribe_params));
 
@@ -184,6 +301,29 @@ static void downlink_data_available(void *arg)
     }
 }
 
+struct pouch_gateway_downlink_context *pouch_gateway_downlink_prepare(struct bt_conn *conn)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+
+    if (NULL == node->downlink_ctx)
+    {
+        node->downlink_ctx = pouch_gateway_downlink_open(downlink_data_available, conn);
+    }
+
+    return node->downlink_ctx;
+}
+
+void pouch_gateway_downlink_discard(struct bt_conn *conn)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+
+    if (node->downlink_ctx)
+    {
+        pouch_gateway_downlink_close(node->downlink_ctx);
+        node->downlink_ctx = NULL;
+    }
+}
+
 struct pouch_gateway_downlink_context *pouch_gateway_downlink_start(struct bt_conn *conn)
 {
     struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
@@ -199,23 +339,13 @@ struct pouch_gateway_downlink_context *pouch_gateway_downlink_start(struct bt_co
         return NULL;
     }
 
-    size_t mtu = bt_gatt_get_mtu(conn);
-    if (mtu < POUCH_GATEWAY_BT_ATT_OVERHEAD)
-    {
-        LOG_ERR("MTU too small");
-        return NULL;
-    }
-    mtu -= POUCH_GATEWAY_BT_ATT_OVERHEAD;
-
-    node->downlink_ctx = pouch_gateway_downlink_open(downlink_data_available, conn);
-    if (NULL == node->downlink_ctx)
+    if (NULL == pouch_gateway_downlink_prepare(conn))
     {
         LOG_ERR("Failed to open downlink");
         return NULL;
     }
 
-    node->packetizer =
-        pouch_gatt_packetizer_start_callback(downlink_packet_fill_cb, node->downlink_ctx);
+    node->packetizer = pouch_gatt_packetizer_start_callback(downlink_packet_fill_cb, conn);
     if (NULL == node->packetizer)
     {
         LOG_ERR("Failed to start packetizer");
@@ -225,16 +355,6 @@ struct pouch_gateway_downlink_context *pouch_gateway_downlink_start(struct bt_co
         return NULL;
     }
 
-    node->downlink_sender = pouch_gatt_sender_create(node->packetizer, send_data_cb, conn, mtu);
-    if (NULL == node->downlink_sender)
-    {
-        LOG_ERR("Failed to create sender");
-
-        cleanup_downlink(conn);
-
-        return NULL;
-    }
-
     node->downlink_subscribe_params.value = 0;
 
     return node->downlink_ctx;
@@ -244,5 +364,14 @@ void pouch_gateway_downlink_cleanup(struct bt_conn *conn)
 {
     struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
 
+    /* Without a subscription there is no notification to clean up on,
+       e.g. for L2CAP sessions or when the node goes away before the cloud
+       sent any downlink data */
+    if (0 == node->downlink_subscribe_params.value)
+    {
+        cleanup_downlink(conn);
+        return;
+    }
+
     bt_gatt_unsubscribe(conn, &node->downlink_subscribe_params);
 }
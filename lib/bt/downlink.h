@@ -6,9 +6,50 @@
 
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+
 struct bt_conn;
 struct pouch_gateway_downlink_context;
 
+/**
+ * Open the downlink context for the given Bluetooth connection.
+ *
+ * The context is reused by @ref pouch_gateway_downlink_start(). This does not touch any
+ * characteristic, so it may be called before discovery.
+ *
+ * @param conn The Bluetooth connection.
+ * @return Pointer to the downlink context.
+ */
+struct pouch_gateway_downlink_context *pouch_gateway_downlink_prepare(struct bt_conn *conn);
+
+/**
+ * Discard a downlink context opened by @ref pouch_gateway_downlink_prepare() that was never
+ * started, after the uplink it was attached to has been discarded.
+ *
+ * @param conn The Bluetooth connection.
+ */
+void pouch_gateway_downlink_discard(struct bt_conn *conn);
+
+/**
+ * Copy the next downlink data of the given Bluetooth connection into a buffer.
+ *
+ * @param conn The Bluetooth connection.
+ * @param dst The buffer to copy into.
+ * @param[inout] dst_len The size of the buffer, set to the number of bytes copied.
+ * @param[out] last Set to true if the copied data ends the downlink.
+ * @return 0 on success, -EAGAIN if the cloud has not provided more data yet, or a negative error
+ * code.
+ */
+int pouch_gateway_downlink_fill(struct bt_conn *conn, void *dst, size_t *dst_len, bool *last);
+
+/**
+ * Close the downlink of the given Bluetooth connection once the node has received all of it.
+ *
+ * @param conn The Bluetooth connection.
+ */
+void pouch_gateway_downlink_complete(struct bt_conn *conn);
+
 /**
  * Start downlink for the given Bluetooth connection.
  *
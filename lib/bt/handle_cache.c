@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/init.h>
+#include <zephyr/settings/settings.h>
+
+#include "handle_cache.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(handle_cache, CONFIG_POUCH_GATEWAY_GATT_LOG_LEVEL);
+
+#define HANDLE_CACHE_SUBTREE "pouch_gw/hdl"
+
+/* Bump when the layout of struct handle_cache_entry changes */
+#define HANDLE_CACHE_VERSION 2
+
+/* Subtree, separator and address type plus address in hex */
+#define HANDLE_CACHE_KEY_LEN (sizeof(HANDLE_CACHE_SUBTREE) + 1 + 2 * (1 + sizeof(bt_addr_t)))
+
+struct handle_cache_entry
+{
+    uint8_t version;
+    uint8_t db_hash[POUCH_GATEWAY_BT_DB_HASH_LEN];
+    struct pouch_gateway_attr_handle handles[POUCH_GATEWAY_GATT_ATTRS];
+};
+
+struct handle_cache_load_ctx
+{
+    struct handle_cache_entry *entry;
+    bool found;
+};
+
+static void handle_cache_key(const bt_addr_le_t *addr, char *key)
+{
+    int len = snprintf(key, HANDLE_CACHE_KEY_LEN, HANDLE_CACHE_SUBTREE "/%02x", addr->type);
+
+    /* Most significant byte first, matching the usual address notation */
+    for (int i = sizeof(addr->a.val) - 1; i >= 0; i--)
+    {
+        len += snprintf(key + len, HANDLE_CACHE_KEY_LEN - len, "%02x", addr->a.val[i]);
+    }
+}
+
+static int handle_cache_load_cb(const char *key,
+                                size_t len,
+                                settings_read_cb read_cb,
+                                void *cb_arg,
+                                void *param)
+{
+    struct handle_cache_load_ctx *ctx = param;
+
+    /* Only the exact key is of interest, not any descendants */
+    if (key != NULL)
+    {
+        return 0;
+    }
+
+    if (len != sizeof(*ctx->entry))
+    {
+        return 0;
+    }
+
+    ssize_t ret = read_cb(cb_arg, ctx->entry, sizeof(*ctx->entry));
+    if (ret == sizeof(*ctx->entry) && ctx->entry->version == HANDLE_CACHE_VERSION)
+    {
+        ctx->found = true;
+    }
+
+    return 0;
+}
+
+int pouch_gateway_handle_cache_load(const bt_addr_le_t *addr,
+                                    const uint8_t db_hash[POUCH_GATEWAY_BT_DB_HASH_LEN],
+                                    struct pouch_gateway_attr_handle *handles)
+{
+    char key[HANDLE_CACHE_KEY_LEN];
+    struct handle_cache_entry entry;
+    struct handle_cache_load_ctx ctx = {
+        .entry = &entry,
+        .found = false,
+    };
+
+    if (!bt_le_bond_exists(BT_ID_DEFAULT, addr))
+    {
+        return -ENOENT;
+    }
+
+    handle_cache_key(addr, key);
+
+    int err = settings_load_subtree_direct(key, handle_cache_load_cb, &ctx);
+    if (err)
+    {
+        LOG_WRN("Failed to load handle cache: %d", err);
+        return err;
+    }
+
+    if (!ctx.found)
+    {
+        return -ENOENT;
+    }
+
+    /* The node changed its attribute table since the handles were cached */
+    if (0 != memcmp(entry.db_hash, db_hash, sizeof(entry.db_hash)))
+    {
+        return -ESTALE;
+    }
+
+    memcpy(handles, entry.handles, sizeof(entry.handles));
+
+    return 0;
+}
+
+void pouch_gateway_handle_cache_store(const bt_addr_le_t *addr,
+                                      const uint8_t db_hash[POUCH_GATEWAY_BT_DB_HASH_LEN],
+                                      const struct pouch_gateway_attr_handle *handles)
+{
+    char key[HANDLE_CACHE_KEY_LEN];
+    struct handle_cache_entry entry = {
+        .version = HANDLE_CACHE_VERSION,
+    };
+
+    if (!bt_le_bond_exists(BT_ID_DEFAULT, addr))
+    {
+        return;
+    }
+
+    memcpy(entry.db_hash, db_hash, sizeof(entry.db_hash));
+    memcpy(entry.handles, handles, sizeof(entry.handles));
+    handle_cache_key(addr, key);
+
+    int err = settings_save_one(key, &entry, sizeof(entry));
+    if (err)
+    {
+        LOG_WRN("Failed to store handle cache: %d", err);
+    }
+}
+
+void pouch_gateway_handle_cache_delete(const bt_addr_le_t *addr)
+{
+    char key[HANDLE_CACHE_KEY_LEN];
+
+    handle_cache_key(addr, key);
+
+    int err = settings_delete(key);
+    if (err)
+    {
+        LOG_WRN("Failed to delete handle cache: %d", err);
+    }
+}
+
+static void handle_cache_bond_deleted(uint8_t id, const bt_addr_le_t *peer)
+{
+    pouch_gateway_handle_cache_delete(peer);
+}
+
+static struct bt_conn_auth_info_cb handle_cache_auth_info_cb = {
+    .bond_deleted = handle_cache_bond_deleted,
+};
+
+static int handle_cache_init(void)
+{
+    return bt_conn_auth_info_cb_register(&handle_cache_auth_info_cb);
+}
+
+SYS_INIT(handle_cache_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
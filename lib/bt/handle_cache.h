@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <zephyr/bluetooth/addr.h>
+
+#include <pouch_gateway/types.h>
+
+/**
+ * Load the cached attribute handles of a bonded node.
+ *
+ * Reads settings, so this should not be called from the Bluetooth receive thread.
+ *
+ * @param addr The identity address of the node.
+ * @param db_hash The current GATT Database Hash of the node.
+ * @param[out] handles Attribute handles, indexed by @ref pouch_gateway_gatt_attr.
+ * @return 0 on success, -ENOENT if the node is not bonded or has no cache entry, -ESTALE if the
+ * entry was cached for a different database hash, or another negative error code on failure.
+ */
+int pouch_gateway_handle_cache_load(const bt_addr_le_t *addr,
+                                    const uint8_t db_hash[POUCH_GATEWAY_BT_DB_HASH_LEN],
+                                    struct pouch_gateway_attr_handle *handles);
+
+/**
+ * Store the discovered attribute handles of a node.
+ *
+ * Nothing is stored unless the node is bonded. Writes settings, so this should not be called from
+ * the Bluetooth receive thread.
+ *
+ * @param addr The identity address of the node.
+ * @param db_hash The GATT Database Hash of the node the handles were discovered with.
+ * @param handles Attribute handles, indexed by @ref pouch_gateway_gatt_attr.
+ */
+void pouch_gateway_handle_cache_store(const bt_addr_le_t *addr,
+                                      const uint8_t db_hash[POUCH_GATEWAY_BT_DB_HASH_LEN],
+                                      const struct pouch_gateway_attr_handle *handles);
+
+/**
+ * Remove the cached attribute handles of a node.
+ *
+ * @param addr The identity address of the node.
+ */
+void pouch_gateway_handle_cache_delete(const bt_addr_le_t *addr);
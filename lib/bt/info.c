@@ -11,7 +11,10 @@
 #include <pouch_gateway/bt/connect.h>
 
 #include "cert.h"
+#include "connect.h"
 #include "info.h"
+#include "session.h"
+#include "window.h"
 
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(info_gatt, CONFIG_POUCH_GATEWAY_GATT_LOG_LEVEL);
@@ -52,7 +55,8 @@ static int info_data_received_cb(void *conn,
     {
         int err = pouch_gateway_info_finish(node->info_ctx,
                                             &node->server_cert_provisioned,
-                                            &node->device_cert_provisioned);
+                                            &node->device_cert_provisioned,
+                                            &node->l2cap_coc_supported);
         node->info_ctx = NULL;
         if (err)
         {
@@ -69,6 +73,8 @@ static int send_ack_cb(void *conn, const void *data, size_t length)
     struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
     uint16_t handle = node->attr_handles[POUCH_GATEWAY_GATT_ATTR_INFO].value;
 
+    pouch_gateway_window_ack_sent(conn, data, length);
+
     return bt_gatt_write_without_response(conn, handle, data, length, false);
 }
 
@@ -106,6 +112,8 @@ static uint8_t info_notify_cb(struct bt_conn *conn,
     }
 
     bool complete = false;
+    pouch_gateway_window_data_received(conn);
+
     int err = pouch_gatt_receiver_receive_data(node->info_receiver, data, length, &complete);
     if (err)
     {
@@ -122,7 +130,7 @@ static uint8_t info_notify_cb(struct bt_conn *conn,
     {
         info_cleanup(conn);
 
-        pouch_gateway_server_cert_write(conn);
+        pouch_gateway_session_cert_exchange_start(conn);
 
         return BT_GATT_ITER_STOP;
     }
@@ -135,6 +143,13 @@ static void subscribe_cb(struct bt_conn *conn, uint8_t err, struct bt_gatt_subsc
     if (err)
     {
         LOG_ERR("CCC Write failed: %d", err);
+
+        /* The node may have changed its attribute table since the handles
+           were cached */
+        if (pouch_gateway_bt_cached_handles_failed(conn))
+        {
+            info_cleanup(conn);
+        }
     }
 }
 
@@ -144,6 +159,7 @@ static void gateway_info_read_start(struct bt_conn *conn)
 
     node->server_cert_provisioned = false;
     node->device_cert_provisioned = false;
+    node->l2cap_coc_supported = false;
 
     node->info_ctx = pouch_gateway_info_start();
     if (node->info_ctx == NULL)
@@ -153,11 +169,13 @@ static void gateway_info_read_start(struct bt_conn *conn)
         return;
     }
 
+    uint8_t window = pouch_gateway_window_size(conn, CONFIG_POUCH_GATT_INFO_WINDOW_SIZE);
+
     node->info_receiver = pouch_gatt_receiver_create(send_ack_cb,
                                                      conn,
                                                      info_data_received_cb,
                                                      conn,
-                                                     CONFIG_POUCH_GATT_INFO_WINDOW_SIZE);
+                                                     window);
     if (NULL == node->info_receiver)
     {
         LOG_ERR("Failed to create receiver");
@@ -0,0 +1,465 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/l2cap.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net_buf.h>
+
+#include <pouch_gateway/downlink.h>
+#include <pouch_gateway/types.h>
+#include <pouch_gateway/uplink.h>
+#include <pouch_gateway/bt/connect.h>
+
+#include "downlink.h"
+#include "l2cap.h"
+#include "link.h"
+#include "session.h"
+#include "uplink.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(l2cap, CONFIG_POUCH_GATEWAY_GATT_LOG_LEVEL);
+
+#ifdef CONFIG_POUCH_GATEWAY_L2CAP
+
+/* Every SDU starts with a flags byte. Uplink SDUs flow from the node to
+   the gateway and downlink SDUs the other way, so the direction needs no
+   marking. Flow control is left to the L2CAP credits, which the gateway
+   returns once an SDU has been passed to the uplink. */
+#define L2CAP_SDU_HDR_LEN 1
+#define L2CAP_SDU_FLAG_LAST BIT(0)
+
+NET_BUF_POOL_FIXED_DEFINE(l2cap_rx_pool,
+                          CONFIG_POUCH_GATEWAY_L2CAP_RX_BUFS,
+                          CONFIG_POUCH_GATEWAY_L2CAP_MTU,
+                          0,
+                          NULL);
+
+NET_BUF_POOL_FIXED_DEFINE(l2cap_tx_pool,
+                          CONFIG_POUCH_GATEWAY_L2CAP_TX_BUFS,
+                          BT_L2CAP_SDU_BUF_SIZE(CONFIG_POUCH_GATEWAY_L2CAP_MTU),
+                          8,
+                          NULL);
+
+/* Downlink blocks that fit in one SDU are sent in place, with the SDU
+   flags and the L2CAP headers written into the block headroom. The block
+   goes back to the pool once its buffer is released. */
+BUILD_ASSERT(CONFIG_POUCH_GATEWAY_BLOCK_HEADROOM
+                 >= L2CAP_SDU_HDR_LEN + BT_L2CAP_SDU_CHAN_SEND_RESERVE,
+             "Downlink block headroom too small for L2CAP headers");
+
+static struct pouch_gateway_downlink_block *l2cap_blocks[CONFIG_POUCH_GATEWAY_L2CAP_TX_BUFS];
+
+static void l2cap_block_destroy(struct net_buf *buf)
+{
+    struct pouch_gateway_downlink_block **block = &l2cap_blocks[net_buf_id(buf)];
+
+    if (NULL != *block)
+    {
+        pouch_gateway_downlink_block_put(*block);
+        *block = NULL;
+    }
+
+    net_buf_destroy(buf);
+}
+
+NET_BUF_POOL_FIXED_DEFINE(l2cap_block_pool,
+                          CONFIG_POUCH_GATEWAY_L2CAP_TX_BUFS,
+                          0,
+                          8,
+                          l2cap_block_destroy);
+
+static struct pouch_gateway_node_info *chan_node(struct bt_l2cap_chan *chan)
+{
+    return CONTAINER_OF(chan, struct pouch_gateway_node_info, l2cap_chan.chan);
+}
+
+static bool conn_is_lost(const struct bt_conn *conn)
+{
+    struct bt_conn_info info;
+
+    return bt_conn_get_info(conn, &info) || BT_CONN_STATE_CONNECTED != info.state;
+}
+
+static int l2cap_sdu_receive(struct pouch_gateway_node_info *node, struct net_buf *buf)
+{
+    if (buf->len < L2CAP_SDU_HDR_LEN)
+    {
+        LOG_ERR("Malformed SDU");
+        return -EBADMSG;
+    }
+
+    uint8_t flags = net_buf_pull_u8(buf);
+
+    return pouch_gateway_uplink_receive(node->conn,
+                                        buf->data,
+                                        buf->len,
+                                        flags & L2CAP_SDU_FLAG_LAST);
+}
+
+static void l2cap_rx_work_handler(struct k_work *work)
+{
+    struct pouch_gateway_node_info *node =
+        CONTAINER_OF(work, struct pouch_gateway_node_info, l2cap_rx_work);
+
+    while (node->l2cap_uplink_started)
+    {
+        /* Holding back the SDUs holds back the credits, so the node
+           stops sending until the uplink drains */
+        struct net_buf *buf = k_fifo_peek_head(&node->l2cap_rx_queue);
+        if (buf == NULL)
+        {
+            return;
+        }
+
+        if (node->uplink != NULL && pouch_gateway_uplink_is_congested(node->uplink, buf->len))
+        {
+            LOG_DBG("Uplink congested, holding back credits");
+            return;
+        }
+
+        buf = k_fifo_get(&node->l2cap_rx_queue, K_NO_WAIT);
+
+        int err = l2cap_sdu_receive(node, buf);
+
+        bt_l2cap_chan_recv_complete(&node->l2cap_chan.chan, buf);
+
+        if (err)
+        {
+            LOG_ERR("Failed to receive uplink SDU: %d", err);
+            pouch_gateway_bt_finished(node->conn);
+            return;
+        }
+    }
+}
+
+static int downlink_block_sdu(struct pouch_gateway_node_info *node,
+                              struct net_buf **sdu,
+                              bool *last)
+{
+    struct pouch_gateway_downlink_block *block;
+    uint8_t *data;
+    size_t len;
+
+    /* The buffer is pointed at the block once it has been taken */
+    struct net_buf *buf = net_buf_alloc_with_data(&l2cap_block_pool, NULL, 0, K_NO_WAIT);
+    if (buf == NULL)
+    {
+        return -EMSGSIZE;
+    }
+
+    int err = pouch_gateway_downlink_block_take(node->downlink_ctx,
+                                                node->l2cap_chan.tx.mtu - L2CAP_SDU_HDR_LEN,
+                                                &block,
+                                                &data,
+                                                &len,
+                                                last);
+    if (err)
+    {
+        net_buf_unref(buf);
+        return err;
+    }
+
+    l2cap_blocks[net_buf_id(buf)] = block;
+
+    net_buf_simple_init_with_data(&buf->b,
+                                  data - CONFIG_POUCH_GATEWAY_BLOCK_HEADROOM,
+                                  CONFIG_POUCH_GATEWAY_BLOCK_HEADROOM + len);
+    net_buf_pull(buf, CONFIG_POUCH_GATEWAY_BLOCK_HEADROOM);
+    net_buf_push_u8(buf, *last ? L2CAP_SDU_FLAG_LAST : 0);
+
+    *sdu = buf;
+
+    return 0;
+}
+
+static int downlink_copy_sdu(struct pouch_gateway_node_info *node,
+                             struct net_buf **sdu,
+                             bool *last)
+{
+    /* Continued once a sent SDU frees its buffer */
+    struct net_buf *buf = net_buf_alloc(&l2cap_tx_pool, K_NO_WAIT);
+    if (buf == NULL)
+    {
+        return -EAGAIN;
+    }
+
+    net_buf_reserve(buf, BT_L2CAP_SDU_CHAN_SEND_RESERVE);
+    uint8_t *flags = net_buf_add(buf, L2CAP_SDU_HDR_LEN);
+
+    size_t len = MIN(net_buf_tailroom(buf), node->l2cap_chan.tx.mtu - L2CAP_SDU_HDR_LEN);
+
+    int err = pouch_gateway_downlink_fill(node->conn, net_buf_tail(buf), &len, last);
+    if (err && -EAGAIN != err)
+    {
+        net_buf_unref(buf);
+        return err;
+    }
+
+    /* Continued once the cloud provides more data */
+    if (0 == len && !*last)
+    {
+        net_buf_unref(buf);
+        return -EAGAIN;
+    }
+
+    net_buf_add(buf, len);
+    *flags = *last ? L2CAP_SDU_FLAG_LAST : 0;
+
+    *sdu = buf;
+
+    return 0;
+}
+
+static void l2cap_tx_work_handler(struct k_work *work)
+{
+    struct pouch_gateway_node_info *node =
+        CONTAINER_OF(work, struct pouch_gateway_node_info, l2cap_tx_work);
+    struct bt_conn *conn = node->conn;
+
+    /* The downlink is complete once its last SDU has been sent */
+    if (0 == atomic_get(&node->l2cap_tx_pending) && node->l2cap_downlink_last
+        && node->downlink_ctx != NULL)
+    {
+        pouch_gateway_downlink_complete(conn);
+        return;
+    }
+
+    while (node->l2cap_connected && node->downlink_ctx != NULL && !node->l2cap_downlink_last)
+    {
+        struct net_buf *buf = NULL;
+        bool last = false;
+
+        int err = downlink_block_sdu(node, &buf, &last);
+        if (-EMSGSIZE == err)
+        {
+            err = downlink_copy_sdu(node, &buf, &last);
+        }
+        if (-EAGAIN == err)
+        {
+            return;
+        }
+        if (err)
+        {
+            LOG_ERR("Failed to get downlink data: %d", err);
+            pouch_gateway_bt_finished(conn);
+            return;
+        }
+
+        size_t len = buf->len - L2CAP_SDU_HDR_LEN;
+
+        atomic_inc(&node->l2cap_tx_pending);
+
+        err = bt_l2cap_chan_send(&node->l2cap_chan.chan, buf);
+        if (err < 0)
+        {
+            LOG_ERR("Failed to send downlink SDU: %d", err);
+            atomic_dec(&node->l2cap_tx_pending);
+            net_buf_unref(buf);
+            pouch_gateway_bt_finished(conn);
+            return;
+        }
+
+        pouch_gateway_link_bytes(conn, len);
+        node->l2cap_downlink_last = last;
+    }
+}
+
+static struct net_buf *l2cap_alloc_buf(struct bt_l2cap_chan *chan)
+{
+    struct net_buf *buf = net_buf_alloc(&l2cap_rx_pool, K_NO_WAIT);
+    if (buf == NULL)
+    {
+        LOG_WRN("Out of SDU buffers");
+    }
+
+    return buf;
+}
+
+static int l2cap_recv(struct bt_l2cap_chan *chan, struct net_buf *buf)
+{
+    struct pouch_gateway_node_info *node = chan_node(chan);
+
+    pouch_gateway_link_bytes(node->conn, buf->len);
+
+    k_fifo_put(&node->l2cap_rx_queue, buf);
+    k_work_submit(&node->l2cap_rx_work);
+
+    return -EINPROGRESS;
+}
+
+static void l2cap_sent(struct bt_l2cap_chan *chan)
+{
+    struct pouch_gateway_node_info *node = chan_node(chan);
+
+    atomic_dec(&node->l2cap_tx_pending);
+    k_work_submit(&node->l2cap_tx_work);
+}
+
+static void l2cap_connected(struct bt_l2cap_chan *chan)
+{
+    struct pouch_gateway_node_info *node = chan_node(chan);
+
+    node->l2cap_connecting = false;
+    node->l2cap_connected = true;
+
+    LOG_INF("L2CAP channel connected (MTU %u/%u)",
+            node->l2cap_chan.tx.mtu,
+            node->l2cap_chan.rx.mtu);
+
+    pouch_gateway_session_phase_done(node->conn, POUCH_GATEWAY_SESSION_PHASE_L2CAP);
+}
+
+static void l2cap_disconnected(struct bt_l2cap_chan *chan)
+{
+    struct pouch_gateway_node_info *node = chan_node(chan);
+    bool was_connected = node->l2cap_connected;
+
+    node->l2cap_connecting = false;
+    node->l2cap_connected = false;
+
+    if (conn_is_lost(node->conn))
+    {
+        return;
+    }
+
+    if (!was_connected)
+    {
+        LOG_WRN("L2CAP channel refused, using GATT");
+        pouch_gateway_session_phase_done(node->conn, POUCH_GATEWAY_SESSION_PHASE_L2CAP);
+        return;
+    }
+
+    /* Pouch data of the session was moved off GATT with the channel */
+    LOG_WRN("L2CAP channel disconnected");
+    pouch_gateway_bt_finished(node->conn);
+}
+
+static const struct bt_l2cap_chan_ops l2cap_chan_ops = {
+    .alloc_buf = l2cap_alloc_buf,
+    .recv = l2cap_recv,
+    .sent = l2cap_sent,
+    .connected = l2cap_connected,
+    .disconnected = l2cap_disconnected,
+};
+
+void pouch_gateway_l2cap_connect(struct bt_conn *conn)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+
+    /* The cert exchange starts over if cached handles turn out stale */
+    if (node->l2cap_connected)
+    {
+        pouch_gateway_session_phase_done(conn, POUCH_GATEWAY_SESSION_PHASE_L2CAP);
+        return;
+    }
+
+    if (node->l2cap_connecting)
+    {
+        return;
+    }
+
+    if (NULL == node->l2cap_rx_work.handler)
+    {
+        k_fifo_init(&node->l2cap_rx_queue);
+        k_work_init(&node->l2cap_rx_work, l2cap_rx_work_handler);
+        k_work_init(&node->l2cap_tx_work, l2cap_tx_work_handler);
+    }
+
+    node->l2cap_chan.chan.ops = &l2cap_chan_ops;
+    node->l2cap_chan.rx.mtu = CONFIG_POUCH_GATEWAY_L2CAP_MTU;
+    node->l2cap_connecting = true;
+
+    int err = bt_l2cap_chan_connect(conn, &node->l2cap_chan.chan, CONFIG_POUCH_GATEWAY_L2CAP_PSM);
+    if (err)
+    {
+        LOG_WRN("Failed to open L2CAP channel (%d), using GATT", err);
+        node->l2cap_connecting = false;
+        pouch_gateway_session_phase_done(conn, POUCH_GATEWAY_SESSION_PHASE_L2CAP);
+    }
+}
+
+bool pouch_gateway_l2cap_is_connected(struct bt_conn *conn)
+{
+    return pouch_gateway_get_node_info(conn)->l2cap_connected;
+}
+
+void pouch_gateway_l2cap_uplink_start(struct bt_conn *conn)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+
+    LOG_DBG("Receiving uplink over L2CAP");
+
+    node->l2cap_uplink_started = true;
+    k_work_submit(&node->l2cap_rx_work);
+}
+
+bool pouch_gateway_l2cap_uplink_started(struct bt_conn *conn)
+{
+    return pouch_gateway_get_node_info(conn)->l2cap_uplink_started;
+}
+
+void pouch_gateway_l2cap_uplink_writable(struct bt_conn *conn)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+
+    k_work_submit(&node->l2cap_rx_work);
+}
+
+void pouch_gateway_l2cap_downlink_kick(struct bt_conn *conn)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+
+    k_work_submit(&node->l2cap_tx_work);
+}
+
+void pouch_gateway_l2cap_cleanup(struct bt_conn *conn)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+    struct k_work_sync sync;
+    struct net_buf *buf;
+
+    if (NULL == node->l2cap_rx_work.handler)
+    {
+        return;
+    }
+
+    /* The handlers use the uplink and downlink, which are cleaned up next */
+    k_work_cancel_sync(&node->l2cap_rx_work, &sync);
+    k_work_cancel_sync(&node->l2cap_tx_work, &sync);
+
+    /* The channel is gone along with the connection, so there are no
+       credits left to return */
+    while (NULL != (buf = k_fifo_get(&node->l2cap_rx_queue, K_NO_WAIT)))
+    {
+        net_buf_unref(buf);
+    }
+}
+
+#else /* CONFIG_POUCH_GATEWAY_L2CAP */
+
+void pouch_gateway_l2cap_connect(struct bt_conn *conn) {}
+
+bool pouch_gateway_l2cap_is_connected(struct bt_conn *conn)
+{
+    return false;
+}
+
+void pouch_gateway_l2cap_uplink_start(struct bt_conn *conn) {}
+
+bool pouch_gateway_l2cap_uplink_started(struct bt_conn *conn)
+{
+    return false;
+}
+
+void pouch_gateway_l2cap_uplink_writable(struct bt_conn *conn) {}
+
+void pouch_gateway_l2cap_downlink_kick(struct bt_conn *conn) {}
+
+void pouch_gateway_l2cap_cleanup(struct bt_conn *conn) {}
+
+#endif /* CONFIG_POUCH_GATEWAY_L2CAP */
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+struct bt_conn;
+
+/**
+ * Open the L2CAP channel for pouch data on the given Bluetooth connection.
+ *
+ * Completes the L2CAP session phase once the channel is connected, or once the node refused it,
+ * in which case pouch data is transferred over GATT.
+ *
+ * @param conn The Bluetooth connection.
+ */
+void pouch_gateway_l2cap_connect(struct bt_conn *conn);
+
+/**
+ * Check whether pouch data of the given Bluetooth connection is transferred over L2CAP.
+ *
+ * @param conn The Bluetooth connection.
+ * @return true if the L2CAP channel is connected.
+ */
+bool pouch_gateway_l2cap_is_connected(struct bt_conn *conn);
+
+/**
+ * Start passing uplink data received on the L2CAP channel to the uplink.
+ *
+ * @param conn The Bluetooth connection.
+ */
+void pouch_gateway_l2cap_uplink_start(struct bt_conn *conn);
+
+/**
+ * Check whether uplink data has been passed from the L2CAP channel.
+ *
+ * @param conn The Bluetooth connection.
+ * @return true if @ref pouch_gateway_l2cap_uplink_start() was called.
+ */
+bool pouch_gateway_l2cap_uplink_started(struct bt_conn *conn);
+
+/**
+ * Continue passing uplink data received on the L2CAP channel after the uplink was congested.
+ *
+ * @param conn The Bluetooth connection.
+ */
+void pouch_gateway_l2cap_uplink_writable(struct bt_conn *conn);
+
+/**
+ * Send downlink data available from the cloud on the L2CAP channel.
+ *
+ * @param conn The Bluetooth connection.
+ */
+void pouch_gateway_l2cap_downlink_kick(struct bt_conn *conn);
+
+/**
+ * Release L2CAP resources of the given Bluetooth connection.
+ *
+ * @param conn The Bluetooth connection.
+ */
+void pouch_gateway_l2cap_cleanup(struct bt_conn *conn);
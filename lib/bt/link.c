@@ -0,0 +1,340 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+
+#include <pouch_gateway/bt/connect.h>
+#include <pouch_gateway/bt/link.h>
+
+#include "link.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(link, CONFIG_POUCH_GATEWAY_GATT_LOG_LEVEL);
+
+#ifdef CONFIG_POUCH_GATEWAY_GATT_LINK
+
+static const struct bt_le_conn_param conn_params[POUCH_GATEWAY_LINK_PROFILES] = {
+    [POUCH_GATEWAY_LINK_PROFILE_BULK] =
+        {
+            .interval_min = CONFIG_POUCH_GATEWAY_GATT_LINK_BULK_INTERVAL,
+            .interval_max = CONFIG_POUCH_GATEWAY_GATT_LINK_BULK_INTERVAL,
+            .latency = 0,
+            .timeout = CONFIG_POUCH_GATEWAY_GATT_LINK_TIMEOUT,
+        },
+    [POUCH_GATEWAY_LINK_PROFILE_IDLE] =
+        {
+            .interval_min = CONFIG_POUCH_GATEWAY_GATT_LINK_IDLE_INTERVAL,
+            .interval_max = CONFIG_POUCH_GATEWAY_GATT_LINK_IDLE_INTERVAL,
+            .latency = 0,
+            .timeout = CONFIG_POUCH_GATEWAY_GATT_LINK_TIMEOUT,
+        },
+};
+
+static const char *const profile_names[POUCH_GATEWAY_LINK_PROFILES] = {
+    [POUCH_GATEWAY_LINK_PROFILE_BULK] = "bulk",
+    [POUCH_GATEWAY_LINK_PROFILE_IDLE] = "idle",
+};
+
+static const char *const phy_names[POUCH_GATEWAY_LINK_PHYS] = {
+    [POUCH_GATEWAY_LINK_PHY_1M] = "1M",
+    [POUCH_GATEWAY_LINK_PHY_CODED] = "Coded",
+};
+
+static struct pouch_gateway_link_stats link_stats;
+static uint64_t link_bytes_total;
+static struct k_spinlock link_stats_lock;
+
+/* PHY of the connections created by the gateway, kept until they are
+   disconnected. Connections created elsewhere count as 1M. */
+struct link_conn_attempt
+{
+    enum pouch_gateway_link_phy phy;
+    bool pending;
+};
+
+static struct link_conn_attempt conn_attempts[CONFIG_BT_MAX_CONN];
+
+static void profile_account(struct pouch_gateway_node_info *node, int64_t now)
+{
+    node->link_time_ms[node->link_profile] += now - node->link_profile_since;
+    node->link_profile_since = now;
+}
+
+static void link_connected(struct bt_conn *conn, uint8_t err)
+{
+    struct link_conn_attempt *attempt = &conn_attempts[bt_conn_index(conn)];
+    struct bt_conn_info info;
+
+    if (err)
+    {
+        attempt->pending = false;
+        return;
+    }
+
+    if (attempt->pending)
+    {
+        K_SPINLOCK(&link_stats_lock)
+        {
+            link_stats.phy[attempt->phy].connected++;
+        }
+    }
+
+    if (bt_conn_get_info(conn, &info) || BT_CONN_ROLE_CENTRAL != info.role)
+    {
+        return;
+    }
+
+    /* Both are requests, the node or controller may settle for less.
+       Nodes connected over the Coded PHY are out of 2M range. */
+    bool coded = attempt->pending && POUCH_GATEWAY_LINK_PHY_CODED == attempt->phy;
+
+    if (IS_ENABLED(CONFIG_BT_USER_PHY_UPDATE) && !coded)
+    {
+        int ret = bt_conn_le_phy_update(conn, BT_CONN_LE_PHY_PARAM_2M);
+        if (ret)
+        {
+            LOG_DBG("Failed to request 2M PHY: %d", ret);
+        }
+    }
+
+    if (IS_ENABLED(CONFIG_BT_USER_DATA_LEN_UPDATE))
+    {
+        int ret = bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+        if (ret)
+        {
+            LOG_DBG("Failed to request data length update: %d", ret);
+        }
+    }
+}
+
+static void link_disconnected(struct bt_conn *conn, uint8_t reason)
+{
+    conn_attempts[bt_conn_index(conn)].pending = false;
+}
+
+static void link_param_updated(struct bt_conn *conn,
+                               uint16_t interval,
+                               uint16_t latency,
+                               uint16_t timeout)
+{
+    LOG_DBG("Connection interval %u, latency %u, timeout %u", interval, latency, timeout);
+}
+
+#ifdef CONFIG_BT_USER_PHY_UPDATE
+static void link_phy_updated(struct bt_conn *conn, struct bt_conn_le_phy_info *param)
+{
+    LOG_DBG("PHY TX %u, RX %u", param->tx_phy, param->rx_phy);
+}
+#endif
+
+#ifdef CONFIG_BT_USER_DATA_LEN_UPDATE
+static void link_data_len_updated(struct bt_conn *conn, struct bt_conn_le_data_len_info *info)
+{
+    LOG_DBG("Data length TX %u, RX %u", info->tx_max_len, info->rx_max_len);
+}
+#endif
+
+BT_CONN_CB_DEFINE(link_conn_callbacks) = {
+    .connected = link_connected,
+    .disconnected = link_disconnected,
+    .le_param_updated = link_param_updated,
+#ifdef CONFIG_BT_USER_PHY_UPDATE
+    .le_phy_updated = link_phy_updated,
+#endif
+#ifdef CONFIG_BT_USER_DATA_LEN_UPDATE
+    .le_data_len_updated = link_data_len_updated,
+#endif
+};
+
+/* The downlink and server certificate senders and the uplink window
+   size the transfer by the MTU when it starts, and cannot change it
+   while packets are in flight. A larger MTU negotiated during the
+   session is therefore not propagated to them, and only applies from
+   the next transfer on. */
+static void link_mtu_updated(struct bt_conn *conn, uint16_t tx, uint16_t rx)
+{
+    LOG_DBG("MTU TX %u, RX %u", tx, rx);
+}
+
+static struct bt_gatt_cb link_gatt_callbacks = {
+    .att_mtu_updated = link_mtu_updated,
+};
+
+static int link_init(void)
+{
+    bt_gatt_cb_register(&link_gatt_callbacks);
+
+    return 0;
+}
+
+SYS_INIT(link_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+const struct bt_le_conn_param *pouch_gateway_link_conn_param(
+    enum pouch_gateway_link_profile profile)
+{
+    return &conn_params[profile];
+}
+
+void pouch_gateway_link_connecting(struct bt_conn *conn, enum pouch_gateway_link_phy phy)
+{
+    struct link_conn_attempt *attempt = &conn_attempts[bt_conn_index(conn)];
+
+    attempt->phy = phy;
+    attempt->pending = true;
+
+    K_SPINLOCK(&link_stats_lock)
+    {
+        link_stats.phy[phy].attempts++;
+    }
+}
+
+void pouch_gateway_link_session_start(struct bt_conn *conn)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+    struct link_conn_attempt *attempt = &conn_attempts[bt_conn_index(conn)];
+
+    node->link_phy = attempt->pending ? attempt->phy : POUCH_GATEWAY_LINK_PHY_1M;
+
+    node->link_profile = POUCH_GATEWAY_LINK_PROFILE_BULK;
+    node->link_profile_since = k_uptime_get();
+    memset(node->link_bytes, 0, sizeof(node->link_bytes));
+    memset(node->link_time_ms, 0, sizeof(node->link_time_ms));
+}
+
+void pouch_gateway_link_session_end(struct bt_conn *conn)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+
+    /* The session never started, e.g. when security failed */
+    if (0 == node->link_profile_since)
+    {
+        return;
+    }
+
+    profile_account(node, k_uptime_get());
+    node->link_profile_since = 0;
+
+    K_SPINLOCK(&link_stats_lock)
+    {
+        for (size_t i = 0; i < POUCH_GATEWAY_LINK_PROFILES; i++)
+        {
+            link_stats.bytes[i] += node->link_bytes[i];
+            link_stats.time_ms[i] += node->link_time_ms[i];
+            link_stats.phy[node->link_phy].bytes += node->link_bytes[i];
+            link_stats.phy[node->link_phy].time_ms += node->link_time_ms[i];
+        }
+    }
+
+    for (size_t i = 0; i < POUCH_GATEWAY_LINK_PROFILES; i++)
+    {
+        if (0 == node->link_time_ms[i])
+        {
+            continue;
+        }
+
+        LOG_INF("Session %s (%s PHY): %llu bytes in %lld ms (%llu B/s)",
+                profile_names[i],
+                phy_names[node->link_phy],
+                (unsigned long long) node->link_bytes[i],
+                node->link_time_ms[i],
+                (unsigned long long) (node->link_bytes[i] * MSEC_PER_SEC
+                                      / node->link_time_ms[i]));
+    }
+}
+
+void pouch_gateway_link_profile_set(struct bt_conn *conn, enum pouch_gateway_link_profile profile)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+
+    if (node->link_profile == profile)
+    {
+        return;
+    }
+
+    profile_account(node, k_uptime_get());
+    node->link_profile = profile;
+
+    LOG_DBG("Switching to %s profile", profile_names[profile]);
+
+    int err = bt_conn_le_param_update(conn, &conn_params[profile]);
+    if (err)
+    {
+        LOG_WRN("Failed to update connection parameters: %d", err);
+    }
+}
+
+void pouch_gateway_link_bytes(struct bt_conn *conn, size_t len)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+
+    node->link_bytes[node->link_profile] += len;
+
+    K_SPINLOCK(&link_stats_lock)
+    {
+        link_bytes_total += len;
+    }
+}
+
+uint64_t pouch_gateway_link_bytes_total(void)
+{
+    uint64_t total;
+
+    K_SPINLOCK(&link_stats_lock)
+    {
+        total = link_bytes_total;
+    }
+
+    return total;
+}
+
+void pouch_gateway_link_stats_get(struct pouch_gateway_link_stats *stats)
+{
+    K_SPINLOCK(&link_stats_lock)
+    {
+        *stats = link_stats;
+    }
+}
+
+#else /* CONFIG_POUCH_GATEWAY_GATT_LINK */
+
+static const struct bt_le_conn_param default_conn_param =
+    BT_LE_CONN_PARAM_INIT(BT_GAP_INIT_CONN_INT_MIN, BT_GAP_INIT_CONN_INT_MAX, 0, 400);
+
+const struct bt_le_conn_param *pouch_gateway_link_conn_param(
+    enum pouch_gateway_link_profile profile)
+{
+    return &default_conn_param;
+}
+
+void pouch_gateway_link_connecting(struct bt_conn *conn, enum pouch_gateway_link_phy phy) {}
+
+void pouch_gateway_link_session_start(struct bt_conn *conn) {}
+
+void pouch_gateway_link_session_end(struct bt_conn *conn) {}
+
+void pouch_gateway_link_profile_set(struct bt_conn *conn, enum pouch_gateway_link_profile profile)
+{
+}
+
+void pouch_gateway_link_bytes(struct bt_conn *conn, size_t len) {}
+
+uint64_t pouch_gateway_link_bytes_total(void)
+{
+    return 0;
+}
+
+void pouch_gateway_link_stats_get(struct pouch_gateway_link_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+#endif /* CONFIG_POUCH_GATEWAY_GATT_LINK */
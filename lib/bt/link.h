@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zephyr/bluetooth/conn.h>
+
+#include <pouch_gateway/bt/link.h>
+
+/**
+ * Get the connection parameters of a profile.
+ *
+ * @param profile The connection parameter profile.
+ * @return Connection parameters to use for the profile.
+ */
+const struct bt_le_conn_param *pouch_gateway_link_conn_param(
+    enum pouch_gateway_link_profile profile);
+
+/**
+ * Record a connection attempt made by the gateway.
+ *
+ * @param conn The Bluetooth connection being established.
+ * @param phy The PHY the connection is established on.
+ */
+void pouch_gateway_link_connecting(struct bt_conn *conn, enum pouch_gateway_link_phy phy);
+
+/**
+ * Start accounting traffic of a node session. Sessions start in the bulk profile.
+ *
+ * @param conn The Bluetooth connection.
+ */
+void pouch_gateway_link_session_start(struct bt_conn *conn);
+
+/**
+ * Finish accounting traffic of a node session, and log its throughput per profile.
+ *
+ * @param conn The Bluetooth connection.
+ */
+void pouch_gateway_link_session_end(struct bt_conn *conn);
+
+/**
+ * Switch the connection to the parameters of a profile.
+ *
+ * @param conn The Bluetooth connection.
+ * @param profile The connection parameter profile.
+ */
+void pouch_gateway_link_profile_set(struct bt_conn *conn, enum pouch_gateway_link_profile profile);
+
+/**
+ * Account payload bytes transferred on the connection.
+ *
+ * @param conn The Bluetooth connection.
+ * @param len Number of payload bytes.
+ */
+void pouch_gateway_link_bytes(struct bt_conn *conn, size_t len);
+
+/**
+ * Get the number of payload bytes transferred on all connections so far, including sessions
+ * still in progress.
+ *
+ * @return Number of payload bytes.
+ */
+uint64_t pouch_gateway_link_bytes_total(void);
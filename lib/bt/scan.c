@@ -4,9 +4,14 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <string.h>
+
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/bluetooth/conn.h>
 #include <zephyr/bluetooth/uuid.h>
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
 
 #include <pouch/transport/gatt/common/types.h>
 #include <pouch/transport/gatt/common/uuids.h>
@@ -17,6 +22,141 @@ LOG_MODULE_REGISTER(scan, CONFIG_POUCH_GATEWAY_GATT_LOG_LEVEL);
 #include <pouch_gateway/bt/bond.h>
 #include <pouch_gateway/bt/scan.h>
 
+#include "link.h"
+#include "scan.h"
+#include "sched.h"
+
+static atomic_t scan_enabled;
+
+/* Serializes starting and pausing the scan, which may happen from the
+   scheduler and from scan updates at the same time */
+static K_MUTEX_DEFINE(scan_lock);
+static bool scan_running;
+
+/* Whether the controller only reports nodes on the accept list */
+static atomic_t scan_filtered;
+
+struct scan_timing
+{
+    uint16_t interval;
+    uint16_t window;
+};
+
+static const struct scan_timing scan_timings[POUCH_GATEWAY_SCAN_PROFILES] = {
+    [POUCH_GATEWAY_SCAN_PROFILE_FAST] =
+        {
+            .interval = CONFIG_POUCH_GATEWAY_GATT_SCAN_FAST_INTERVAL,
+            .window = CONFIG_POUCH_GATEWAY_GATT_SCAN_FAST_WINDOW,
+        },
+    [POUCH_GATEWAY_SCAN_PROFILE_BALANCED] =
+        {
+            .interval = CONFIG_POUCH_GATEWAY_GATT_SCAN_BALANCED_INTERVAL,
+            .window = CONFIG_POUCH_GATEWAY_GATT_SCAN_BALANCED_WINDOW,
+        },
+    [POUCH_GATEWAY_SCAN_PROFILE_LOW] =
+        {
+            .interval = CONFIG_POUCH_GATEWAY_GATT_SCAN_LOW_INTERVAL,
+            .window = CONFIG_POUCH_GATEWAY_GATT_SCAN_LOW_WINDOW,
+        },
+};
+
+BUILD_ASSERT(CONFIG_POUCH_GATEWAY_GATT_SCAN_FAST_WINDOW
+                     <= CONFIG_POUCH_GATEWAY_GATT_SCAN_FAST_INTERVAL
+                 && CONFIG_POUCH_GATEWAY_GATT_SCAN_BALANCED_WINDOW
+                        <= CONFIG_POUCH_GATEWAY_GATT_SCAN_BALANCED_INTERVAL
+                 && CONFIG_POUCH_GATEWAY_GATT_SCAN_LOW_WINDOW
+                        <= CONFIG_POUCH_GATEWAY_GATT_SCAN_LOW_INTERVAL,
+             "Scan window must not exceed the scan interval");
+
+static const char *const scan_profile_names[POUCH_GATEWAY_SCAN_PROFILES] = {
+    [POUCH_GATEWAY_SCAN_PROFILE_FAST] = "fast",
+    [POUCH_GATEWAY_SCAN_PROFILE_BALANCED] = "balanced",
+    [POUCH_GATEWAY_SCAN_PROFILE_LOW] = "low",
+};
+
+static enum pouch_gateway_scan_profile scan_profile = POUCH_GATEWAY_SCAN_PROFILE_FAST;
+
+static struct pouch_gateway_scan_profile_stats scan_profile_stats[POUCH_GATEWAY_SCAN_PROFILES];
+static struct pouch_gateway_scan_profile_stats scan_paused_stats;
+static struct k_spinlock scan_stats_lock;
+
+/* Traffic is accounted to the scan state in effect whenever the state or
+   the number of sessions changes, so that the short pauses for connection
+   attempts are accounted as well. Nothing is accounted until scanning has
+   been started. Without CONFIG_POUCH_GATEWAY_GATT_LINK, no bytes are
+   counted. */
+static struct pouch_gateway_scan_profile_stats *scan_stats_current;
+static int64_t scan_stats_since;
+static uint64_t scan_stats_bytes;
+static size_t scan_stats_sessions;
+
+/* Called with scan_stats_lock held */
+static void scan_stats_account_locked(void)
+{
+    int64_t now = k_uptime_get();
+    uint64_t bytes = pouch_gateway_link_bytes_total();
+
+    if (scan_stats_current != NULL)
+    {
+        int64_t elapsed = now - scan_stats_since;
+
+        scan_stats_current->time_ms += elapsed;
+        scan_stats_current->session_time_ms += scan_stats_sessions * elapsed;
+        scan_stats_current->bytes += bytes - scan_stats_bytes;
+    }
+
+    scan_stats_since = now;
+    scan_stats_bytes = bytes;
+}
+
+/* Called with scan_lock held, after scan_running or scan_profile changed */
+static void scan_stats_switch(void)
+{
+    K_SPINLOCK(&scan_stats_lock)
+    {
+        scan_stats_account_locked();
+        scan_stats_current =
+            scan_running ? &scan_profile_stats[scan_profile] : &scan_paused_stats;
+    }
+}
+
+static void scan_stats_connected(struct bt_conn *conn, uint8_t err)
+{
+    if (err)
+    {
+        return;
+    }
+
+    K_SPINLOCK(&scan_stats_lock)
+    {
+        scan_stats_account_locked();
+        scan_stats_sessions++;
+    }
+}
+
+static void scan_stats_disconnected(struct bt_conn *conn, uint8_t reason)
+{
+    K_SPINLOCK(&scan_stats_lock)
+    {
+        scan_stats_account_locked();
+
+        if (scan_stats_sessions > 0)
+        {
+            scan_stats_sessions--;
+        }
+    }
+}
+
+BT_CONN_CB_DEFINE(scan_stats_conn_callbacks) = {
+    .connected = scan_stats_connected,
+    .disconnected = scan_stats_disconnected,
+};
+
+/* The accept list mirrors the bond table and is rebuilt the next time
+   scanning starts after the bond table changed */
+static bool accept_list_stale = true;
+static bool accept_list_valid;
+
 static inline bool version_is_compatible(const struct pouch_gatt_adv_data *adv_data)
 {
     uint8_t self_ver =
@@ -99,104 +239,530 @@ static void bond_filter(const struct bt_bond_info *info, void *user_data)
     }
 }
 
+/* Advertisements are repeated many times a second while nothing about
+   the node changes. Each report is hashed with its address, and a report
+   identical to a recent one gets the same decision without parsing.
+   Advertisements and scan responses of a node are remembered in separate
+   entries, so that they do not replace each other. */
+struct scan_dedup_entry
+{
+    bt_addr_le_t addr;
+    uint32_t hash;
+    uint32_t generation;
+    int64_t decided_at;
+    bool is_bonded;
+    bool offered;
+};
+
+/* Entries of older generations are ignored, so the cache is reset
+   without touching it, e.g. from interrupt context */
+static atomic_t dedup_generation = ATOMIC_INIT(1);
+
+static atomic_t stats_seen;
+static atomic_t stats_deduped;
+static atomic_t stats_processed;
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+static uint32_t fnv1a(uint32_t hash, const void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+
+    return hash;
+}
+
+#ifdef CONFIG_POUCH_GATEWAY_GATT_SCAN_DEDUP
+
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_POUCH_GATEWAY_GATT_SCAN_DEDUP_SIZE),
+             "Dedup cache size must be a power of two");
+
+static struct scan_dedup_entry dedup_cache[CONFIG_POUCH_GATEWAY_GATT_SCAN_DEDUP_SIZE];
+
+static struct scan_dedup_entry *dedup_slot(uint32_t key_hash)
+{
+    return &dedup_cache[key_hash & (ARRAY_SIZE(dedup_cache) - 1)];
+}
+
+static bool dedup_hit(const struct scan_dedup_entry *entry,
+                      const bt_addr_le_t *addr,
+                      uint32_t hash,
+                      int64_t now)
+{
+    return entry->generation == (uint32_t) atomic_get(&dedup_generation) && entry->hash == hash
+        && bt_addr_le_eq(&entry->addr, addr)
+        && now - entry->decided_at < CONFIG_POUCH_GATEWAY_GATT_SCAN_DEDUP_TTL;
+}
+
+#else /* CONFIG_POUCH_GATEWAY_GATT_SCAN_DEDUP */
+
+static struct scan_dedup_entry *dedup_slot(uint32_t key_hash)
+{
+    return NULL;
+}
+
+static bool dedup_hit(const struct scan_dedup_entry *entry,
+                      const bt_addr_le_t *addr,
+                      uint32_t hash,
+                      int64_t now)
+{
+    return false;
+}
+
+#endif /* CONFIG_POUCH_GATEWAY_GATT_SCAN_DEDUP */
+
+/* Parse a report and decide whether to offer the node to the scheduler */
+static bool device_evaluate(int8_t rssi, struct net_buf_simple *ad, struct tf_data *tf)
+{
+    char addr_str[BT_ADDR_LE_STR_LEN];
+
+    bt_data_parse(ad, data_cb, tf);
+
+    if (!tf->is_tf)
+    {
+        return false;
+    }
+
+    bt_addr_le_to_str(tf->addr, addr_str, sizeof(addr_str));
+
+    if (atomic_get(&scan_filtered))
+    {
+        /* Only bonded nodes get past the controller */
+        tf->is_bonded = true;
+    }
+    else if (IS_ENABLED(CONFIG_POUCH_GATEWAY_GATT_SCAN_FILTER_BONDED))
+    {
+        bt_foreach_bond(BT_ID_DEFAULT, bond_filter, tf);
+
+        LOG_DBG("Pouch device found: %s, (RSSI %d) (bonded %d)",
+                addr_str,
+                rssi,
+                (int) tf->is_bonded);
+    }
+    else
+    {
+        LOG_DBG("Pouch device found: %s, (RSSI %d)", addr_str, rssi);
+    }
+
+    LOG_DBG("version=0x%0x flags=0%0x", tf->adv_data.version, tf->adv_data.flags);
+
+    if (!version_is_compatible(&tf->adv_data))
+    {
+        return false;
+    }
+
+    if (!tf->is_bonded && !pouch_gateway_bonding_is_enabled())
+    {
+        return false;
+    }
+
+    if (tf->is_bonded && !sync_requested(&tf->adv_data))
+    {
+        return false;
+    }
+
+    return true;
+}
+
 static void device_found(const bt_addr_le_t *addr,
                          int8_t rssi,
                          uint8_t type,
+                         uint16_t props,
+                         uint8_t phy,
                          struct net_buf_simple *ad)
 {
-    char addr_str[BT_ADDR_LE_STR_LEN];
     struct tf_data tf = {
         .addr = addr,
         .is_tf = false,
         /* When filtering bonded devices is disabled, treat all devices as bonded */
         .is_bonded = IS_ENABLED(CONFIG_POUCH_GATEWAY_GATT_SCAN_FILTER_BONDED) ? false : true,
     };
-    int err;
+
+    atomic_inc(&stats_seen);
 
     /* We're only interested in connectable events */
     if (type != BT_GAP_ADV_TYPE_ADV_IND && type != BT_GAP_ADV_TYPE_ADV_DIRECT_IND
-        && type != BT_GAP_ADV_TYPE_SCAN_RSP)
+        && type != BT_GAP_ADV_TYPE_SCAN_RSP
+        && !(type == BT_GAP_ADV_TYPE_EXT_ADV
+             && (props & (BT_GAP_ADV_PROP_CONNECTABLE | BT_GAP_ADV_PROP_SCAN_RESPONSE))))
     {
         return;
     }
 
-    bt_data_parse(ad, data_cb, &tf);
+    uint32_t hash = fnv1a(FNV_OFFSET_BASIS, addr, sizeof(*addr));
+    hash = fnv1a(hash, &type, sizeof(type));
 
-    if (!tf.is_tf)
+    struct scan_dedup_entry *entry = dedup_slot(hash);
+    int64_t now = k_uptime_get();
+
+    if (entry != NULL)
     {
-        return;
+        hash = fnv1a(hash, &phy, sizeof(phy));
+        hash = fnv1a(hash, ad->data, ad->len);
+
+        if (dedup_hit(entry, addr, hash, now))
+        {
+            atomic_inc(&stats_deduped);
+
+            /* Offers are repeated, so that the scheduler sees the node
+               is still around */
+            if (entry->offered)
+            {
+                pouch_gateway_sched_offer(addr, rssi, phy, entry->is_bonded);
+            }
+
+            return;
+        }
     }
 
-    bt_addr_le_to_str(addr, addr_str, sizeof(addr_str));
+    atomic_inc(&stats_processed);
 
-    if (IS_ENABLED(CONFIG_POUCH_GATEWAY_GATT_SCAN_FILTER_BONDED))
-    {
-        bt_foreach_bond(BT_ID_DEFAULT, bond_filter, &tf);
+    bool offer = device_evaluate(rssi, ad, &tf);
 
-        LOG_DBG("Pouch device found: %s, (RSSI %d) (bonded %d)",
-                addr_str,
-                rssi,
-                (int) tf.is_bonded);
+    if (entry != NULL)
+    {
+        bt_addr_le_copy(&entry->addr, addr);
+        entry->hash = hash;
+        entry->generation = atomic_get(&dedup_generation);
+        entry->decided_at = now;
+        entry->is_bonded = tf.is_bonded;
+        entry->offered = offer;
     }
-    else
+
+    if (offer)
     {
-        LOG_DBG("Pouch device found: %s, (RSSI %d)", addr_str, rssi);
+        pouch_gateway_sched_offer(addr, rssi, phy, tf.is_bonded);
     }
+}
 
-    LOG_DBG("version=0x%0x flags=0%0x", tf.adv_data.version, tf.adv_data.flags);
+/* The PHY a node was found on is only reported to registered scan
+   callbacks */
+static void scan_recv(const struct bt_le_scan_recv_info *info, struct net_buf_simple *ad)
+{
+    device_found(info->addr, info->rssi, info->adv_type, info->adv_props, info->primary_phy, ad);
+}
+
+static struct bt_le_scan_cb scan_cb = {
+    .recv = scan_recv,
+};
 
-    if (!version_is_compatible(&tf.adv_data))
+void pouch_gateway_scan_stats_get(struct pouch_gateway_scan_stats *stats)
+{
+    stats->seen = atomic_get(&stats_seen);
+    stats->deduped = atomic_get(&stats_deduped);
+    stats->processed = atomic_get(&stats_processed);
+
+    K_SPINLOCK(&scan_stats_lock)
     {
-        return;
+        /* Include the time since the last change */
+        scan_stats_account_locked();
+
+        memcpy(stats->profile, scan_profile_stats, sizeof(stats->profile));
+        stats->paused = scan_paused_stats;
     }
+}
 
-    if (!tf.is_bonded && !pouch_gateway_bonding_is_enabled())
+static void accept_list_add(const struct bt_bond_info *info, void *user_data)
+{
+    int *err = user_data;
+
+    if (*err)
     {
         return;
     }
 
-    if (tf.is_bonded && !sync_requested(&tf.adv_data))
+    *err = bt_le_filter_accept_list_add(&info->addr);
+}
+
+/* Bonded nodes using private addresses are matched by the controller
+   through the resolving list, which the host keeps in sync with the
+   bond table itself */
+static void accept_list_sync(void)
+{
+    int err = bt_le_filter_accept_list_clear();
+    if (0 == err)
     {
-        return;
+        bt_foreach_bond(BT_ID_DEFAULT, accept_list_add, &err);
     }
 
-    err = bt_le_scan_stop();
+    accept_list_stale = false;
+    accept_list_valid = (0 == err);
+
     if (err)
     {
-        LOG_ERR("Failed to stop scanning");
-        return;
+        LOG_WRN("Failed to sync accept list (err %d), filtering bonded nodes on host", err);
     }
+}
 
-    struct bt_conn *conn = NULL;
-    err = bt_conn_le_create(addr, BT_CONN_LE_CREATE_CONN, BT_LE_CONN_PARAM_DEFAULT, &conn);
-    if (err)
+static void scan_update_work_handler(struct k_work *work)
+{
+    k_mutex_lock(&scan_lock, K_FOREVER);
+
+    /* Scanning paused for a connection attempt picks up the changes
+       when it resumes */
+    if (scan_running)
     {
-        LOG_ERR("Create auto conn failed (%d)", err);
-        pouch_gateway_scan_start();
+        int err = bt_le_scan_stop();
+        if (err && err != -EALREADY)
+        {
+            LOG_ERR("Failed to stop scanning (err %d)", err);
+        }
+        else
+        {
+            scan_running = false;
+            scan_stats_switch();
+
+            pouch_gateway_scan_start();
+        }
+    }
+
+    k_mutex_unlock(&scan_lock);
+}
+
+static K_WORK_DEFINE(scan_update_work, scan_update_work_handler);
+
+void pouch_gateway_scan_update(void)
+{
+    /* Earlier decisions depend on the bond table and bonding state */
+    atomic_inc(&dedup_generation);
+
+    if (IS_ENABLED(CONFIG_POUCH_GATEWAY_GATT_SCAN_ACCEPT_LIST))
+    {
+        k_work_submit(&scan_update_work);
+    }
+}
+
+static void scan_profile_apply(enum pouch_gateway_scan_profile profile)
+{
+    k_mutex_lock(&scan_lock, K_FOREVER);
+
+    bool changed = scan_profile != profile;
+    scan_profile = profile;
+
+    k_mutex_unlock(&scan_lock);
+
+    if (changed)
+    {
+        LOG_DBG("Switching to %s scan profile", scan_profile_names[profile]);
+        k_work_submit(&scan_update_work);
+    }
+}
+
+void pouch_gateway_scan_profile_set(enum pouch_gateway_scan_profile profile)
+{
+    if (IS_ENABLED(CONFIG_POUCH_GATEWAY_GATT_SCAN_ADAPTIVE))
+    {
+        LOG_WRN("Scan profile is selected automatically");
         return;
     }
 
-    /* Disable bonding after first connect attempt */
-    if (!tf.is_bonded)
+    scan_profile_apply(profile);
+}
+
+#ifdef CONFIG_POUCH_GATEWAY_GATT_SCAN_ADAPTIVE
+
+/* Every period, the next profile is picked from the number of sessions
+   and their throughput over the period. A new profile takes effect, and
+   is accounted, once scanning has been restarted with it. */
+static void scan_adapt_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(scan_adapt_work, scan_adapt_work_handler);
+
+static void scan_adapt_work_handler(struct k_work *work)
+{
+    static int64_t last_time;
+    static uint64_t last_bytes;
+    int64_t now = k_uptime_get();
+    uint64_t bytes = pouch_gateway_link_bytes_total();
+    size_t sessions;
+
+    K_SPINLOCK(&scan_stats_lock)
+    {
+        sessions = scan_stats_sessions;
+    }
+
+    if (last_time != 0)
     {
-        pouch_gateway_bonding_disable();
+        int64_t elapsed = now - last_time;
+        uint64_t transferred = bytes - last_bytes;
+        uint64_t throughput = elapsed > 0 ? transferred * MSEC_PER_SEC / elapsed : 0;
+        enum pouch_gateway_scan_profile profile = POUCH_GATEWAY_SCAN_PROFILE_FAST;
+
+        /* Leave airtime to the connections while they have data to move */
+        if (sessions >= CONFIG_POUCH_GATEWAY_GATT_SCAN_ADAPTIVE_LOW_SESSIONS
+            || throughput >= CONFIG_POUCH_GATEWAY_GATT_SCAN_ADAPTIVE_BUSY_THROUGHPUT)
+        {
+            profile = POUCH_GATEWAY_SCAN_PROFILE_LOW;
+        }
+        else if (sessions > 0)
+        {
+            profile = POUCH_GATEWAY_SCAN_PROFILE_BALANCED;
+        }
+
+        scan_profile_apply(profile);
     }
+
+    last_time = now;
+    last_bytes = bytes;
+
+    k_work_schedule(&scan_adapt_work, K_MSEC(CONFIG_POUCH_GATEWAY_GATT_SCAN_ADAPTIVE_PERIOD));
 }
 
+#endif /* CONFIG_POUCH_GATEWAY_GATT_SCAN_ADAPTIVE */
+
 void pouch_gateway_scan_start(void)
 {
+    static bool scan_cb_registered;
+    uint32_t options = BT_LE_SCAN_OPT_NONE;
     int err;
 
-    err = bt_le_scan_start(BT_LE_SCAN_PARAM(BT_LE_SCAN_TYPE_ACTIVE,
-                                            BT_LE_SCAN_OPT_NONE,
-                                            BT_GAP_SCAN_FAST_INTERVAL_MIN,
-                                            BT_GAP_SCAN_FAST_WINDOW),
-                           device_found);
+    atomic_set(&scan_enabled, 1);
+
+#ifdef CONFIG_POUCH_GATEWAY_GATT_SCAN_ADAPTIVE
+    k_work_schedule(&scan_adapt_work, K_NO_WAIT);
+#endif
+
+    k_mutex_lock(&scan_lock, K_FOREVER);
+
+    if (scan_running)
+    {
+        LOG_DBG("Scanning already active");
+        goto unlock;
+    }
+
+    /* Registered here rather than at init, so that applications running
+       their own scan do not feed the scheduler */
+    if (!scan_cb_registered)
+    {
+        bt_le_scan_cb_register(&scan_cb);
+        scan_cb_registered = true;
+    }
+
+    /* Nodes out of 1M range are still heard on the Coded PHY */
+    if (IS_ENABLED(CONFIG_POUCH_GATEWAY_GATT_SCAN_CODED))
+    {
+        options |= BT_LE_SCAN_OPT_CODED;
+    }
+
+    /* Unbonded nodes need to be seen while bonding is enabled */
+    if (IS_ENABLED(CONFIG_POUCH_GATEWAY_GATT_SCAN_ACCEPT_LIST)
+        && !pouch_gateway_bonding_is_enabled())
+    {
+        if (accept_list_stale)
+        {
+            accept_list_sync();
+        }
+
+        if (accept_list_valid)
+        {
+            options |= BT_LE_SCAN_OPT_FILTER_ACCEPT_LIST;
+        }
+    }
+
+    const struct scan_timing *timing = &scan_timings[scan_profile];
+
+    /* Scan requests are only needed if nodes put their service data
+       into scan responses */
+    uint8_t type = IS_ENABLED(CONFIG_POUCH_GATEWAY_GATT_SCAN_PASSIVE) ? BT_LE_SCAN_TYPE_PASSIVE
+                                                                      : BT_LE_SCAN_TYPE_ACTIVE;
+
+    err = bt_le_scan_start(BT_LE_SCAN_PARAM(type,
+                                            options,
+                                            timing->interval,
+                                            timing->window),
+                           NULL);
+    if (err == -EALREADY)
+    {
+        LOG_DBG("Scanning already active");
+        scan_running = true;
+        scan_stats_switch();
+        goto unlock;
+    }
     if (err)
     {
         LOG_ERR("Scanning failed to start (err %d)", err);
-        return;
+        goto unlock;
+    }
+
+    scan_running = true;
+    scan_stats_switch();
+    atomic_set(&scan_filtered, options & BT_LE_SCAN_OPT_FILTER_ACCEPT_LIST ? 1 : 0);
+
+    LOG_INF("Scanning successfully started (%s profile)%s",
+            scan_profile_names[scan_profile],
+            options & BT_LE_SCAN_OPT_FILTER_ACCEPT_LIST ? " (bonded nodes only)" : "");
+
+unlock:
+    k_mutex_unlock(&scan_lock);
+}
+
+int pouch_gateway_scan_pause(void)
+{
+    k_mutex_lock(&scan_lock, K_FOREVER);
+
+    int err = bt_le_scan_stop();
+    if (err == -EALREADY)
+    {
+        err = 0;
     }
+    if (0 == err)
+    {
+        scan_running = false;
+        scan_stats_switch();
+    }
+
+    k_mutex_unlock(&scan_lock);
 
-    LOG_INF("Scanning successfully started");
+    return err;
 }
+
+void pouch_gateway_scan_resume(void)
+{
+    if (atomic_get(&scan_enabled))
+    {
+        pouch_gateway_scan_start();
+    }
+}
+
+#ifdef CONFIG_POUCH_GATEWAY_GATT_SCAN_ACCEPT_LIST
+
+static void accept_list_invalidate(void)
+{
+    k_mutex_lock(&scan_lock, K_FOREVER);
+    accept_list_stale = true;
+    k_mutex_unlock(&scan_lock);
+
+    pouch_gateway_scan_update();
+}
+
+static void scan_pairing_complete(struct bt_conn *conn, bool bonded)
+{
+    if (bonded)
+    {
+        accept_list_invalidate();
+    }
+}
+
+static void scan_bond_deleted(uint8_t id, const bt_addr_le_t *peer)
+{
+    accept_list_invalidate();
+}
+
+static struct bt_conn_auth_info_cb scan_auth_info_cb = {
+    .pairing_complete = scan_pairing_complete,
+    .bond_deleted = scan_bond_deleted,
+};
+
+static int scan_init(void)
+{
+    return bt_conn_auth_info_cb_register(&scan_auth_info_cb);
+}
+
+SYS_INIT(scan_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+#endif /* CONFIG_POUCH_GATEWAY_GATT_SCAN_ACCEPT_LIST */
@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+/**
+ * Pause scanning for a connection attempt.
+ *
+ * @return 0 on success, negative error code otherwise.
+ */
+int pouch_gateway_scan_pause(void);
+
+/**
+ * Resume scanning after it was paused for a connection attempt.
+ *
+ * Does nothing unless scanning was started with @ref pouch_gateway_scan_start().
+ */
+void pouch_gateway_scan_resume(void);
+
+/**
+ * Apply a change of the bond table or of the bonding state to the scan filter policy.
+ *
+ * Scanning is restarted with the new policy if it is running. Safe to call from interrupt
+ * context.
+ */
+void pouch_gateway_scan_update(void);
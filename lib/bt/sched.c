@@ -0,0 +1,328 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/kernel.h>
+
+#include <pouch_gateway/bt/bond.h>
+
+#include "link.h"
+#include "scan.h"
+#include "sched.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(sched, CONFIG_POUCH_GATEWAY_GATT_LOG_LEVEL);
+
+/* A candidate popped for a connection attempt keeps its address and
+   request time while it is not stale, so that a node offered again after
+   a failed attempt keeps the age of its sync request */
+struct sched_candidate
+{
+    bt_addr_le_t addr;
+    int64_t requested_at;
+    int64_t queued_at;
+    int64_t last_seen;
+    int8_t rssi;
+    uint8_t phy;
+    bool is_bonded;
+    bool in_use;
+};
+
+static struct sched_candidate candidates[CONFIG_POUCH_GATEWAY_SCHED_QUEUE_SIZE];
+static struct k_spinlock candidates_lock;
+
+/* Connection currently being established, if any */
+static struct bt_conn *pending_conn;
+
+static bool candidate_is_stale(const struct sched_candidate *c, int64_t now)
+{
+    return now - c->last_seen > CONFIG_POUCH_GATEWAY_SCHED_CANDIDATE_TIMEOUT * MSEC_PER_SEC;
+}
+
+static int32_t candidate_score(const struct sched_candidate *c, int64_t now)
+{
+    int32_t waited_s = (now - c->queued_at) / MSEC_PER_SEC;
+    int32_t age_s = (now - c->requested_at) / MSEC_PER_SEC;
+
+    return c->rssi + waited_s * CONFIG_POUCH_GATEWAY_SCHED_WAIT_WEIGHT
+        + age_s * CONFIG_POUCH_GATEWAY_SCHED_AGE_WEIGHT;
+}
+
+static void count_conn(struct bt_conn *conn, void *user_data)
+{
+    size_t *count = user_data;
+
+    (*count)++;
+}
+
+static bool conn_slot_available(void)
+{
+    size_t count = 0;
+
+    bt_conn_foreach(BT_CONN_TYPE_LE, count_conn, &count);
+
+    return count < CONFIG_BT_MAX_CONN;
+}
+
+static bool is_connected(const bt_addr_le_t *addr)
+{
+    struct bt_conn *conn = bt_conn_lookup_addr_le(BT_ID_DEFAULT, addr);
+    if (conn == NULL)
+    {
+        return false;
+    }
+
+    bt_conn_unref(conn);
+
+    return true;
+}
+
+static const struct bt_conn_le_create_param *candidate_create_param(
+    const struct sched_candidate *c)
+{
+    static const struct bt_conn_le_create_param coded_create_param =
+        BT_CONN_LE_CREATE_PARAM_INIT(BT_CONN_LE_OPT_CODED | BT_CONN_LE_OPT_NO_1M,
+                                     BT_GAP_SCAN_FAST_INTERVAL,
+                                     BT_GAP_SCAN_FAST_INTERVAL);
+
+    if (IS_ENABLED(CONFIG_POUCH_GATEWAY_GATT_SCAN_CODED) && BT_GAP_LE_PHY_CODED == c->phy)
+    {
+        return &coded_create_param;
+    }
+
+    return BT_CONN_LE_CREATE_CONN;
+}
+
+static bool candidate_pop_best(struct sched_candidate *best)
+{
+    int64_t now = k_uptime_get();
+    struct sched_candidate *selected = NULL;
+    int32_t selected_score = 0;
+
+    K_SPINLOCK(&candidates_lock)
+    {
+        for (size_t i = 0; i < ARRAY_SIZE(candidates); i++)
+        {
+            struct sched_candidate *c = &candidates[i];
+
+            if (!c->in_use)
+            {
+                continue;
+            }
+
+            if (candidate_is_stale(c, now))
+            {
+                c->in_use = false;
+                continue;
+            }
+
+            int32_t score = candidate_score(c, now);
+            if (selected == NULL || score > selected_score)
+            {
+                selected = c;
+                selected_score = score;
+            }
+        }
+
+        if (selected != NULL)
+        {
+            *best = *selected;
+            selected->in_use = false;
+        }
+    }
+
+    return selected != NULL;
+}
+
+static void sched_kick(void)
+{
+    struct sched_candidate c;
+    int err;
+
+    if (pending_conn != NULL)
+    {
+        LOG_DBG("Connection attempt in progress");
+        return;
+    }
+
+    if (!conn_slot_available())
+    {
+        LOG_DBG("No free connection slot");
+        return;
+    }
+
+    while (candidate_pop_best(&c))
+    {
+        if (is_connected(&c.addr))
+        {
+            continue;
+        }
+
+        err = pouch_gateway_scan_pause();
+        if (err)
+        {
+            LOG_ERR("Failed to stop scanning");
+            return;
+        }
+
+        LOG_DBG("Connecting to candidate (RSSI %d, PHY %u, waited %lld ms)",
+                c.rssi,
+                c.phy,
+                k_uptime_get() - c.queued_at);
+
+        /* Scanning is resumed once the connection attempt completes */
+        err = bt_conn_le_create(&c.addr,
+                                candidate_create_param(&c),
+                                pouch_gateway_link_conn_param(POUCH_GATEWAY_LINK_PROFILE_BULK),
+                                &pending_conn);
+        if (err)
+        {
+            LOG_ERR("Create auto conn failed (%d)", err);
+            pending_conn = NULL;
+            pouch_gateway_scan_resume();
+            return;
+        }
+
+        pouch_gateway_link_connecting(pending_conn,
+                                      BT_GAP_LE_PHY_CODED == c.phy ? POUCH_GATEWAY_LINK_PHY_CODED
+                                                                   : POUCH_GATEWAY_LINK_PHY_1M);
+
+        /* Disable bonding after first connect attempt */
+        if (!c.is_bonded)
+        {
+            pouch_gateway_bonding_disable();
+        }
+
+        return;
+    }
+}
+
+void pouch_gateway_sched_offer(const bt_addr_le_t *addr, int8_t rssi, uint8_t phy, bool is_bonded)
+{
+    int64_t now = k_uptime_get();
+    int64_t requested_at = now;
+
+    K_SPINLOCK(&candidates_lock)
+    {
+        struct sched_candidate *slot = NULL;
+        struct sched_candidate *victim = NULL;
+        int32_t victim_score = INT32_MAX;
+
+        for (size_t i = 0; i < ARRAY_SIZE(candidates); i++)
+        {
+            struct sched_candidate *c = &candidates[i];
+            bool is_free = !c->in_use || candidate_is_stale(c, now);
+            bool was_popped = !c->in_use && !candidate_is_stale(c, now);
+
+            if (c->in_use && bt_addr_le_eq(&c->addr, addr))
+            {
+                slot = c;
+                if (candidate_is_stale(c, now))
+                {
+                    slot->requested_at = now;
+                    slot->queued_at = now;
+                }
+                break;
+            }
+
+            if (was_popped && bt_addr_le_eq(&c->addr, addr))
+            {
+                requested_at = c->requested_at;
+            }
+
+            int32_t score = is_free ? INT32_MIN : candidate_score(c, now);
+            if (score < victim_score)
+            {
+                victim = c;
+                victim_score = score;
+            }
+        }
+
+        if (slot == NULL)
+        {
+            /* Replace a free slot, or the lowest ranked candidate if the
+               new one ranks higher */
+            int32_t age_s = (now - requested_at) / MSEC_PER_SEC;
+
+            if (victim_score != INT32_MIN
+                && victim_score >= rssi + age_s * CONFIG_POUCH_GATEWAY_SCHED_AGE_WEIGHT)
+            {
+                LOG_DBG("Queue full, dropping candidate (RSSI %d)", rssi);
+                K_SPINLOCK_BREAK;
+            }
+
+            slot = victim;
+            bt_addr_le_copy(&slot->addr, addr);
+            slot->requested_at = requested_at;
+            slot->queued_at = now;
+            slot->in_use = true;
+        }
+
+        slot->last_seen = now;
+        slot->rssi = rssi;
+        slot->phy = phy;
+        slot->is_bonded = is_bonded;
+    }
+
+    sched_kick();
+}
+
+/* The node is served, so a later sync request starts a new age */
+static void candidate_forget(const bt_addr_le_t *addr)
+{
+    K_SPINLOCK(&candidates_lock)
+    {
+        for (size_t i = 0; i < ARRAY_SIZE(candidates); i++)
+        {
+            struct sched_candidate *c = &candidates[i];
+
+            if (!c->in_use && bt_addr_le_eq(&c->addr, addr))
+            {
+                bt_addr_le_copy(&c->addr, BT_ADDR_LE_ANY);
+            }
+        }
+    }
+}
+
+static void sched_conn_connected(struct bt_conn *conn, uint8_t err)
+{
+    if (conn != pending_conn)
+    {
+        return;
+    }
+
+    pending_conn = NULL;
+
+    if (!err)
+    {
+        candidate_forget(bt_conn_get_dst(conn));
+    }
+
+    /* Serve the next queued node right away, otherwise keep looking for
+       other nodes while this session is running. */
+    sched_kick();
+
+    if (pending_conn == NULL)
+    {
+        pouch_gateway_scan_resume();
+    }
+}
+
+static void sched_conn_disconnected(struct bt_conn *conn, uint8_t reason)
+{
+    sched_kick();
+
+    if (pending_conn == NULL)
+    {
+        pouch_gateway_scan_resume();
+    }
+}
+
+BT_CONN_CB_DEFINE(sched_conn_callbacks) = {
+    .connected = sched_conn_connected,
+    .disconnected = sched_conn_disconnected,
+};
@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/bluetooth/addr.h>
+
+/**
+ * Offer a node that requested sync to the connection scheduler.
+ *
+ * The node is queued (or its queue entry refreshed) and the scheduler immediately connects to
+ * the best candidate if a connection slot is available.
+ *
+ * @param addr The node address.
+ * @param rssi The RSSI of the advertisement.
+ * @param phy The primary PHY of the advertisement (BT_GAP_LE_PHY_*), which is also used to
+ * connect.
+ * @param is_bonded True if the node is bonded with the gateway.
+ */
+void pouch_gateway_sched_offer(const bt_addr_le_t *addr, int8_t rssi, uint8_t phy, bool is_bonded);
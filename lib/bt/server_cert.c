@@ -18,6 +18,8 @@
 #include <pouch_gateway/cert.h>
 
 #include "cert.h"
+#include "link.h"
+#include "session.h"
 
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(server_cert_gatt, CONFIG_POUCH_GATEWAY_GATT_LOG_LEVEL);
@@ -32,10 +34,10 @@ static void server_cert_cleanup(struct bt_conn *conn)
         node->server_cert_ctx = NULL;
     }
 
-    if (node->packetizer)
+    if (node->server_cert_packetizer)
     {
-        pouch_gatt_packetizer_finish(node->packetizer);
-        node->packetizer = NULL;
+        pouch_gatt_packetizer_finish(node->server_cert_packetizer);
+        node->server_cert_packetizer = NULL;
     }
 
     if (node->server_cert_sender)
@@ -73,7 +75,11 @@ static int send_data_cb(void *conn, const void *data, size_t length)
     uint16_t server_cert_handle = node->attr_handles[POUCH_GATEWAY_GATT_ATTR_SERVER_CERT].value;
 
     int err = bt_gatt_write_without_response(conn, server_cert_handle, data, length, false);
-    if (err)
+    if (0 == err)
+    {
+        pouch_gateway_link_bytes(conn, length);
+    }
+    else
     {
         /* This error gets propagated to server_cert_notify_cb via
            pouch_gatt_sender_receive_ack, so no cleanup required here */
@@ -99,8 +105,8 @@ static uint8_t server_cert_notify_cb(struct bt_conn *conn,
 
         switch (node->server_cert_next)
         {
-            case SERVER_CERT_NEXT_DEVICE_CERT:
-                pouch_gateway_device_cert_read(conn);
+            case SERVER_CERT_NEXT_DONE:
+                pouch_gateway_session_phase_done(conn, POUCH_GATEWAY_SESSION_PHASE_SERVER_CERT);
                 break;
 
             case SERVER_CERT_NEXT_SERVER_CERT:
@@ -164,7 +170,7 @@ static uint8_t server_cert_notify_cb(struct bt_conn *conn,
 
         if (is_newest)
         {
-            node->server_cert_next = SERVER_CERT_NEXT_DEVICE_CERT;
+            node->server_cert_next = SERVER_CERT_NEXT_DONE;
         }
         else
         {
@@ -189,7 +195,7 @@ void pouch_gateway_server_cert_write(struct bt_conn *conn)
     if (node->server_cert_provisioned)
     {
         LOG_INF("Server cert already provisioned, skipping write");
-        pouch_gateway_device_cert_read(conn);
+        pouch_gateway_session_phase_done(conn, POUCH_GATEWAY_SESSION_PHASE_SERVER_CERT);
         return;
     }
 
@@ -210,9 +216,9 @@ void pouch_gateway_server_cert_write(struct bt_conn *conn)
         return;
     }
 
-    node->packetizer =
+    node->server_cert_packetizer =
         pouch_gatt_packetizer_start_callback(server_cert_fill_cb, node->server_cert_ctx);
-    if (node->packetizer == NULL)
+    if (node->server_cert_packetizer == NULL)
     {
         LOG_ERR("Failed to start packetizer");
         server_cert_cleanup(conn);
@@ -230,7 +236,8 @@ void pouch_gateway_server_cert_write(struct bt_conn *conn)
     }
     mtu -= POUCH_GATEWAY_BT_ATT_OVERHEAD;
 
-    node->server_cert_sender = pouch_gatt_sender_create(node->packetizer, send_data_cb, conn, mtu);
+    node->server_cert_sender =
+        pouch_gatt_sender_create(node->server_cert_packetizer, send_data_cb, conn, mtu);
     if (NULL == node->server_cert_sender)
     {
         LOG_ERR("Failed to create sender");
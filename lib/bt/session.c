@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/sys/atomic.h>
+
+#include <pouch_gateway/bt/connect.h>
+
+#include "cert.h"
+#include "l2cap.h"
+#include "session.h"
+#include "uplink.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(session, CONFIG_POUCH_GATEWAY_GATT_LOG_LEVEL);
+
+void pouch_gateway_session_cert_exchange_start(struct bt_conn *conn)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+
+    LOG_DBG("Starting cert exchange %lld ms after connection",
+            k_uptime_get() - node->connected_at);
+
+    bool l2cap = IS_ENABLED(CONFIG_POUCH_GATEWAY_L2CAP) && node->l2cap_coc_supported;
+
+    atomic_set(&node->pending_phases,
+               BIT(POUCH_GATEWAY_SESSION_PHASE_SERVER_CERT)
+                   | BIT(POUCH_GATEWAY_SESSION_PHASE_DEVICE_CERT)
+                   | (l2cap ? BIT(POUCH_GATEWAY_SESSION_PHASE_L2CAP) : 0));
+
+    /* Any phase may complete right away, e.g. when already provisioned.
+       A failing cert phase ends the connection instead of completing,
+       while a failing L2CAP channel falls back to GATT. */
+    if (l2cap)
+    {
+        pouch_gateway_l2cap_connect(conn);
+    }
+
+    pouch_gateway_server_cert_write(conn);
+    pouch_gateway_device_cert_read(conn);
+}
+
+void pouch_gateway_session_phase_done(struct bt_conn *conn,
+                                      enum pouch_gateway_session_phase phase)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+
+    atomic_val_t pending = atomic_and(&node->pending_phases, ~BIT(phase));
+    if (!(pending & BIT(phase)))
+    {
+        LOG_WRN("Phase %d already done", phase);
+        return;
+    }
+
+    if (0 == (pending & ~BIT(phase)))
+    {
+        LOG_DBG("Cert exchange complete %lld ms after connection",
+                k_uptime_get() - node->connected_at);
+
+        pouch_gateway_uplink_start(conn);
+    }
+}
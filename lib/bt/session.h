@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+struct bt_conn;
+
+/** Session phases that must complete before the uplink starts */
+enum pouch_gateway_session_phase
+{
+    POUCH_GATEWAY_SESSION_PHASE_SERVER_CERT,
+    POUCH_GATEWAY_SESSION_PHASE_DEVICE_CERT,
+    POUCH_GATEWAY_SESSION_PHASE_L2CAP,
+};
+
+/**
+ * Start the certificate exchange for the given Bluetooth connection.
+ *
+ * The server certificate write and the device certificate read use independent
+ * characteristics, so they run concurrently. If the node supports it, the L2CAP channel for
+ * pouch data is opened alongside. The uplink starts once all have completed.
+ *
+ * @param conn The Bluetooth connection.
+ */
+void pouch_gateway_session_cert_exchange_start(struct bt_conn *conn);
+
+/**
+ * Mark a session phase as completed.
+ *
+ * @param conn The Bluetooth connection.
+ * @param phase The completed phase.
+ */
+void pouch_gateway_session_phase_done(struct bt_conn *conn,
+                                      enum pouch_gateway_session_phase phase);
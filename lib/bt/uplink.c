@@ -5,6 +5,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/bluetooth/conn.h>
@@ -18,11 +19,57 @@
 #include <pouch_gateway/bt/connect.h>
 
 #include "downlink.h"
+#include "l2cap.h"
+#include "link.h"
 #include "uplink.h"
+#include "window.h"
 
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(uplink_gatt, CONFIG_POUCH_GATEWAY_GATT_LOG_LEVEL);
 
+BUILD_ASSERT(CONFIG_POUCH_GATEWAY_UPLINK_NUM_BLOCKS
+                 >= CONFIG_BT_MAX_CONN * CONFIG_POUCH_GATEWAY_UPLINK_MIN_BLOCKS,
+             "Uplink buffer too small to serve CONFIG_BT_MAX_CONN nodes");
+
+/* Copy received data straight into the uplink's current block */
+static int uplink_append(struct pouch_gateway_node_info *node,
+                         const uint8_t *data,
+                         size_t length,
+                         bool is_last)
+{
+    do
+    {
+        /* The uplink might end (and node->uplink be cleared) with any commit */
+        if (node->uplink == NULL)
+        {
+            return -ENOLINK;
+        }
+
+        uint8_t *buf;
+        size_t room;
+
+        int err = pouch_gateway_uplink_reserve(node->uplink, &buf, &room);
+        if (err)
+        {
+            return err;
+        }
+
+        size_t len = MIN(length, room);
+
+        memcpy(buf, data, len);
+        data += len;
+        length -= len;
+
+        err = pouch_gateway_uplink_commit(node->uplink, len, is_last && length == 0);
+        if (err)
+        {
+            return err;
+        }
+    } while (length > 0);
+
+    return 0;
+}
+
 static int uplink_data_received_cb(void *conn,
                                    const void *data,
                                    size_t length,
@@ -36,30 +83,135 @@ static int uplink_data_received_cb(void *conn,
         return -ENOLINK;
     }
 
-    int err = pouch_gateway_uplink_write(node->uplink, data, length, is_last);
+    pouch_gateway_link_bytes(conn, length);
+
+    int err = uplink_append(node, data, length, is_last);
     if (err)
     {
         LOG_ERR("Failed to write uplink data: %d", err);
-        pouch_gateway_uplink_close(node->uplink);
-        node->uplink = NULL;
+        if (node->uplink != NULL)
+        {
+            pouch_gateway_uplink_close(node->uplink);
+            node->uplink = NULL;
+        }
     }
-    else if (is_last)
+    else if (is_last && node->uplink != NULL)
     {
         pouch_gateway_uplink_close(node->uplink);
         node->uplink = NULL;
+
+        /* Nothing to transfer until the cloud responds */
+        pouch_gateway_link_profile_set(conn, POUCH_GATEWAY_LINK_PROFILE_IDLE);
     }
 
     return err;
 }
 
-static int send_ack_cb(void *conn, const void *data, size_t length)
+int pouch_gateway_uplink_receive(struct bt_conn *conn,
+                                 const void *data,
+                                 size_t length,
+                                 bool is_last)
+{
+    return uplink_data_received_cb(conn, data, length, false, is_last);
+}
+
+static struct k_spinlock deferred_ack_lock;
+
+static int write_ack(struct bt_conn *conn, const void *data, size_t length)
 {
     struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
     uint16_t handle = node->attr_handles[POUCH_GATEWAY_GATT_ATTR_UPLINK].value;
 
+    pouch_gateway_window_ack_sent(conn, data, length);
+
     return bt_gatt_write_without_response_cb(conn, handle, data, length, false, NULL, NULL);
 }
 
+static int send_ack_cb(void *conn, const void *data, size_t length)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+
+    if (node->uplink != NULL && length <= sizeof(node->uplink_deferred_ack)
+        && pouch_gatt_packetizer_is_ack(data, length)
+        && pouch_gateway_uplink_is_congested(node->uplink, node->uplink_window_len))
+    {
+        /* Hold back the ACK, so the node stops sending until the uplink
+           drains. A newer ACK supersedes any previously deferred one. */
+
+        K_SPINLOCK(&deferred_ack_lock)
+        {
+            memcpy(node->uplink_deferred_ack, data, length);
+            node->uplink_deferred_ack_len = length;
+        }
+
+        LOG_DBG("Uplink congested, deferring ACK");
+
+        if (!pouch_gateway_uplink_is_congested(node->uplink, node->uplink_window_len))
+        {
+            k_work_submit(&node->uplink_ack_work);
+        }
+
+        return 0;
+    }
+
+    K_SPINLOCK(&deferred_ack_lock)
+    {
+        node->uplink_deferred_ack_len = 0;
+    }
+
+    return write_ack(conn, data, length);
+}
+
+static void uplink_ack_work_handler(struct k_work *work)
+{
+    struct pouch_gateway_node_info *node =
+        CONTAINER_OF(work, struct pouch_gateway_node_info, uplink_ack_work);
+    uint8_t ack[sizeof(node->uplink_deferred_ack)];
+    size_t length = 0;
+
+    /* Woken up by blocks returned to the pool, which might have been
+       taken by another uplink in the meantime */
+    struct pouch_gateway_uplink *uplink = node->uplink;
+    if (uplink != NULL && pouch_gateway_uplink_is_congested(uplink, node->uplink_window_len))
+    {
+        return;
+    }
+
+    K_SPINLOCK(&deferred_ack_lock)
+    {
+        length = node->uplink_deferred_ack_len;
+        memcpy(ack, node->uplink_deferred_ack, length);
+        node->uplink_deferred_ack_len = 0;
+    }
+
+    if (length == 0)
+    {
+        return;
+    }
+
+    LOG_DBG("Uplink drained, sending deferred ACK");
+
+    int err = write_ack(node->conn, ack, length);
+    if (err)
+    {
+        LOG_ERR("Failed to send deferred ACK: %d", err);
+        pouch_gateway_bt_finished(node->conn);
+    }
+}
+
+static void uplink_writable_cb(void *conn)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+
+    if (pouch_gateway_l2cap_is_connected(conn))
+    {
+        pouch_gateway_l2cap_uplink_writable(conn);
+        return;
+    }
+
+    k_work_submit(&node->uplink_ack_work);
+}
+
 static uint8_t uplink_notify_cb(struct bt_conn *conn,
                                 struct bt_gatt_subscribe_params *params,
                                 const void *data,
@@ -95,6 +247,8 @@ static uint8_t uplink_notify_cb(struct bt_conn *conn,
     }
 
     bool complete = false;
+    pouch_gateway_window_data_received(conn);
+
     int err = pouch_gatt_receiver_receive_data(node->uplink_receiver, data, length, &complete);
     if (err)
     {
@@ -120,6 +274,60 @@ static void uplink_end_cb(void *conn, enum pouch_gateway_uplink_result res)
     if (POUCH_GATEWAY_UPLINK_SUCCESS != res)
     {
         pouch_gateway_bt_finished(conn);
+        return;
+    }
+
+    LOG_INF("Uplink complete %lld ms after connection", k_uptime_get() - node->connected_at);
+}
+
+static int uplink_open(struct bt_conn *conn,
+                       struct pouch_gateway_downlink_context *downlink,
+                       bool speculative)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+
+    /* Initialized once per connection, as the ACK work of a previous
+       uplink in the session may still be pending */
+    if (NULL == node->uplink_ack_work.handler)
+    {
+        k_work_init(&node->uplink_ack_work, uplink_ack_work_handler);
+    }
+
+    K_SPINLOCK(&deferred_ack_lock)
+    {
+        node->uplink_deferred_ack_len = 0;
+    }
+
+    /* A speculative uplink may never carry a pouch, so it is not spooled */
+    node->uplink =
+        speculative
+            ? pouch_gateway_uplink_open_cloud(downlink, uplink_end_cb, uplink_writable_cb, conn)
+            : pouch_gateway_uplink_open(downlink, uplink_end_cb, uplink_writable_cb, conn);
+    if (node->uplink == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
+void pouch_gateway_uplink_prepare(struct bt_conn *conn)
+{
+    if (!IS_ENABLED(CONFIG_POUCH_GATEWAY_UPLINK_SPECULATIVE_OPEN))
+    {
+        return;
+    }
+
+    struct pouch_gateway_downlink_context *downlink = pouch_gateway_downlink_prepare(conn);
+    if (downlink == NULL)
+    {
+        return;
+    }
+
+    if (uplink_open(conn, downlink, true))
+    {
+        LOG_DBG("Speculative uplink open failed");
+        pouch_gateway_downlink_discard(conn);
     }
 }
 
@@ -142,19 +350,37 @@ void pouch_gateway_uplink_start(struct bt_conn *conn)
         return;
     }
 
-    node->uplink = pouch_gateway_uplink_open(downlink, uplink_end_cb, conn);
-    if (node->uplink == NULL)
+    if (node->uplink == NULL && uplink_open(conn, downlink, false))
     {
         LOG_ERR("Failed to open pouch uplink");
         pouch_gateway_bt_finished(conn);
         return;
     }
 
+    if (pouch_gateway_l2cap_is_connected(conn))
+    {
+        pouch_gateway_l2cap_uplink_start(conn);
+        return;
+    }
+
+    uint8_t window = pouch_gateway_window_size(conn, CONFIG_POUCH_GATT_UPLINK_WINDOW_SIZE);
+    size_t payload = bt_gatt_get_mtu(conn) - 3;
+
+    /* The node sends the first window before any ACK could hold it back,
+       so it has to fit into the uplink's current block if the pool has
+       nothing to spare */
+    node->uplink_window_len = window * payload;
+    if (pouch_gateway_uplink_is_congested(node->uplink, node->uplink_window_len))
+    {
+        window = CLAMP(CONFIG_GOLIOTH_BLOCKWISE_UPLOAD_MAX_BLOCK_SIZE / payload, 1, window);
+        node->uplink_window_len = window * payload;
+    }
+
     node->uplink_receiver = pouch_gatt_receiver_create(send_ack_cb,
                                                        conn,
                                                        uplink_data_received_cb,
                                                        conn,
-                                                       CONFIG_POUCH_GATT_UPLINK_WINDOW_SIZE);
+                                                       window);
     if (node->uplink_receiver == NULL)
     {
         LOG_ERR("Failed to create uplink sender");
@@ -181,9 +407,17 @@ void pouch_gateway_uplink_start(struct bt_conn *conn)
 void pouch_gateway_uplink_cleanup(struct bt_conn *conn)
 {
     struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+    bool started = node->uplink_receiver != NULL || pouch_gateway_l2cap_uplink_started(conn);
 
     bt_gatt_unsubscribe(conn, &node->uplink_subscribe_params);
 
+    if (node->uplink_ack_work.handler != NULL)
+    {
+        struct k_work_sync sync;
+
+        k_work_cancel_sync(&node->uplink_ack_work, &sync);
+    }
+
     if (node->uplink_receiver)
     {
         pouch_gatt_receiver_destroy(node->uplink_receiver);
@@ -192,7 +426,20 @@ void pouch_gateway_uplink_cleanup(struct bt_conn *conn)
 
     if (node->uplink)
     {
-        pouch_gateway_uplink_close(node->uplink);
+        /* A speculatively opened session that the node never got to use
+           is torn down without involving the cloud */
+        if (!started && 0 == pouch_gateway_uplink_discard(node->uplink))
+        {
+            pouch_gateway_downlink_discard(conn);
+        }
+        else
+        {
+            /* An interrupted uplink is not kept for the node to resume.
+               The node sends its pouch again from the start when it
+               reconnects, as the pouch transport has no way to continue
+               a transfer from an offset. */
+            pouch_gateway_uplink_close(node->uplink);
+        }
         node->uplink = NULL;
     }
 }
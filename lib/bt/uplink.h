@@ -6,8 +6,22 @@
 
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+
 struct bt_conn;
 
+/**
+ * Open the cloud uplink session for the given Bluetooth connection ahead of
+ * @ref pouch_gateway_uplink_start(), so that session setup overlaps discovery and the cert
+ * exchange.
+ *
+ * Failures are not fatal, as the session is opened again when the uplink starts.
+ *
+ * @param conn The Bluetooth connection.
+ */
+void pouch_gateway_uplink_prepare(struct bt_conn *conn);
+
 /**
  * Start uplink for the given Bluetooth connection.
  *
@@ -15,6 +29,21 @@ struct bt_conn;
  */
 void pouch_gateway_uplink_start(struct bt_conn *conn);
 
+/**
+ * Pass uplink data received outside of the uplink characteristic to the uplink of the given
+ * Bluetooth connection.
+ *
+ * @param conn The Bluetooth connection.
+ * @param data The received data.
+ * @param length The length of the data.
+ * @param is_last Whether this data ends the uplink.
+ * @return 0 on success, negative error code otherwise.
+ */
+int pouch_gateway_uplink_receive(struct bt_conn *conn,
+                                 const void *data,
+                                 size_t length,
+                                 bool is_last);
+
 /**
  * Clean up uplink resources for the given Bluetooth connection.
  *
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/bluetooth/addr.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/kernel.h>
+
+#include <pouch/transport/gatt/common/packetizer.h>
+
+#include <pouch_gateway/bt/connect.h>
+
+#include "window.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(window, CONFIG_POUCH_GATEWAY_GATT_LOG_LEVEL);
+
+/* The window of a receiver is fixed when it is created, so what is
+   learned from one transfer applies to the next one on the connection,
+   e.g. from the info and certificate transfers to the uplink. The window
+   is also kept per node address for its next connection. The shortest
+   round trip is not, as it depends on the connection parameters.
+
+   The window grows by one packet for every ACK round trip that stays
+   within the tolerance of the shortest round trip seen, and is halved
+   whenever the gateway has to NACK. */
+
+#ifdef CONFIG_POUCH_GATEWAY_GATT_ADAPTIVE_WINDOW
+
+struct window_peer
+{
+    bt_addr_le_t addr;
+    int64_t last_used;
+    uint8_t window;
+};
+
+static struct window_peer peers[CONFIG_POUCH_GATEWAY_GATT_WINDOW_PEERS];
+static K_MUTEX_DEFINE(peers_lock);
+
+static uint8_t window_load(struct bt_conn *conn)
+{
+    const bt_addr_le_t *addr = bt_conn_get_dst(conn);
+    uint8_t window = 0;
+
+    k_mutex_lock(&peers_lock, K_FOREVER);
+
+    for (size_t i = 0; i < ARRAY_SIZE(peers); i++)
+    {
+        if (0 != peers[i].window && bt_addr_le_eq(&peers[i].addr, addr))
+        {
+            window = peers[i].window;
+            break;
+        }
+    }
+
+    k_mutex_unlock(&peers_lock);
+
+    return window;
+}
+
+void pouch_gateway_window_save(struct bt_conn *conn)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+    const bt_addr_le_t *addr = bt_conn_get_dst(conn);
+    struct window_peer *victim = &peers[0];
+
+    if (0 == node->gatt_window)
+    {
+        return;
+    }
+
+    k_mutex_lock(&peers_lock, K_FOREVER);
+
+    /* Reuse the entry of the same node, a free entry or the least
+       recently used one, in that order of preference */
+    for (size_t i = 0; i < ARRAY_SIZE(peers); i++)
+    {
+        struct window_peer *peer = &peers[i];
+
+        if (0 != peer->window && bt_addr_le_eq(&peer->addr, addr))
+        {
+            victim = peer;
+            break;
+        }
+
+        if (0 == victim->window)
+        {
+            continue;
+        }
+
+        if (0 == peer->window || peer->last_used < victim->last_used)
+        {
+            victim = peer;
+        }
+    }
+
+    bt_addr_le_copy(&victim->addr, addr);
+    victim->last_used = k_uptime_get();
+    victim->window = node->gatt_window;
+
+    k_mutex_unlock(&peers_lock);
+
+    /* Saved once per connection */
+    node->gatt_window = 0;
+}
+
+uint8_t pouch_gateway_window_size(struct bt_conn *conn, uint8_t configured)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+
+    if (0 == node->gatt_window)
+    {
+        node->gatt_window = window_load(conn);
+    }
+
+    if (0 == node->gatt_window)
+    {
+        node->gatt_window = MIN(configured, CONFIG_POUCH_GATEWAY_GATT_WINDOW_MAX);
+    }
+
+    LOG_DBG("Using window of %u", node->gatt_window);
+
+    return node->gatt_window;
+}
+
+void pouch_gateway_window_ack_sent(struct bt_conn *conn, const void *data, size_t length)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+
+    if (0 == node->gatt_window)
+    {
+        return;
+    }
+
+    if (!pouch_gatt_packetizer_is_ack(data, length))
+    {
+        node->gatt_window = MAX(node->gatt_window / 2, 1);
+        node->gatt_ack_sent_at = 0;
+
+        LOG_DBG("NACK, window decreased to %u", node->gatt_window);
+        return;
+    }
+
+    node->gatt_ack_sent_at = k_uptime_get();
+}
+
+void pouch_gateway_window_data_received(struct bt_conn *conn)
+{
+    struct pouch_gateway_node_info *node = pouch_gateway_get_node_info(conn);
+
+    if (0 == node->gatt_window || 0 == node->gatt_ack_sent_at)
+    {
+        return;
+    }
+
+    /* The first packet after an ACK closes the round trip */
+    uint32_t rtt = k_uptime_get() - node->gatt_ack_sent_at;
+    node->gatt_ack_sent_at = 0;
+
+    if (0 == node->gatt_rtt_min || rtt < node->gatt_rtt_min)
+    {
+        node->gatt_rtt_min = MAX(rtt, 1);
+    }
+
+    if (rtt * 100 > node->gatt_rtt_min * CONFIG_POUCH_GATEWAY_GATT_WINDOW_RTT_TOLERANCE)
+    {
+        LOG_DBG("ACK round trip %u ms, holding window at %u", rtt, node->gatt_window);
+        return;
+    }
+
+    if (node->gatt_window < CONFIG_POUCH_GATEWAY_GATT_WINDOW_MAX)
+    {
+        node->gatt_window++;
+    }
+}
+
+#else /* CONFIG_POUCH_GATEWAY_GATT_ADAPTIVE_WINDOW */
+
+uint8_t pouch_gateway_window_size(struct bt_conn *conn, uint8_t configured)
+{
+    return configured;
+}
+
+void pouch_gateway_window_ack_sent(struct bt_conn *conn, const void *data, size_t length) {}
+
+void pouch_gateway_window_data_received(struct bt_conn *conn) {}
+
+void pouch_gateway_window_save(struct bt_conn *conn) {}
+
+#endif /* CONFIG_POUCH_GATEWAY_GATT_ADAPTIVE_WINDOW */
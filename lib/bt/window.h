@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/bluetooth/conn.h>
+
+/**
+ * Get the window size for a receiver created on the connection.
+ *
+ * @param conn The Bluetooth connection.
+ * @param configured The configured window size of the characteristic.
+ * @return The window size learned on the connection, or @p configured if nothing was learned
+ * yet or CONFIG_POUCH_GATEWAY_GATT_ADAPTIVE_WINDOW is disabled.
+ */
+uint8_t pouch_gateway_window_size(struct bt_conn *conn, uint8_t configured);
+
+/**
+ * Record an ACK or NACK sent to the node.
+ *
+ * @param conn The Bluetooth connection.
+ * @param data The ACK or NACK packet.
+ * @param length Length of the packet.
+ */
+void pouch_gateway_window_ack_sent(struct bt_conn *conn, const void *data, size_t length);
+
+/**
+ * Record a data packet received from the node.
+ *
+ * @param conn The Bluetooth connection.
+ */
+void pouch_gateway_window_data_received(struct bt_conn *conn);
+
+/**
+ * Remember the window learned on the connection for the next connection of the same node.
+ *
+ * @param conn The Bluetooth connection.
+ */
+void pouch_gateway_window_save(struct bt_conn *conn);
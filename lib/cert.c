@@ -6,21 +6,31 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <mbedtls/x509_crt.h>
 #include <psa/crypto.h>
 
 #include <pouch_gateway/cert.h>
 
+#include "cert_cache.h"
+
 #include <golioth/gateway.h>
 #include <golioth/golioth_status.h>
 
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
 #include <zephyr/sys/atomic_types.h>
 
+#ifdef CONFIG_POUCH_GATEWAY_SERVER_CERT_PERSIST
+#include <zephyr/settings/settings.h>
+#endif
+
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(cert, CONFIG_POUCH_GATEWAY_LOG_LEVEL);
 
-static struct golioth_client *_client;
+/* Set by the main thread, read by the Bluetooth threads uploading certs */
+static atomic_ptr_t _client;
 
 static uint8_t server_crt_buf[CONFIG_POUCH_GATEWAY_SERVER_CERT_MAX_LEN];
 static atomic_t server_crt_len;
@@ -30,10 +40,19 @@ static atomic_t server_crt_id;
 
 struct pouch_gateway_device_cert_context
 {
+    struct k_work work;
+    pouch_gateway_device_cert_done_cb done_cb;
+    void *done_cb_arg;
     size_t len;
     uint8_t buf[CONFIG_POUCH_GATEWAY_DEVICE_CERT_MAX_LEN];
 };
 
+/* Device certificate uploads block on a cloud round trip, so they run on
+   their own queue rather than on the Bluetooth receive path */
+static K_THREAD_STACK_DEFINE(device_cert_work_q_stack,
+                             CONFIG_POUCH_GATEWAY_DEVICE_CERT_UPLOAD_STACK_SIZE);
+static struct k_work_q device_cert_work_q;
+
 struct pouch_gateway_server_cert_context
 {
     atomic_val_t id;
@@ -75,18 +94,52 @@ void pouch_gateway_device_cert_abort(struct pouch_gateway_device_cert_context *c
     free(context);
 }
 
-int pouch_gateway_device_cert_finish(struct pouch_gateway_device_cert_context *context)
+static int device_cert_upload(struct pouch_gateway_device_cert_context *context)
 {
     enum golioth_status status;
 
     if (IS_ENABLED(CONFIG_POUCH_GATEWAY_CLOUD))
     {
-        status = golioth_gateway_device_cert_set(_client, context->buf, context->len, 5);
+        uint8_t digest[CERT_CACHE_DIGEST_LEN];
+        bool cacheable = IS_ENABLED(CONFIG_POUCH_GATEWAY_DEVICE_CERT_CACHE)
+            && 0 == cert_cache_digest(context->buf, context->len, digest);
+
+        if (cacheable && cert_cache_lookup(digest))
+        {
+            LOG_INF("Device cert uploaded recently, skipping upload");
+            pouch_gateway_device_cert_abort(context);
+            return 0;
+        }
+
+        struct golioth_client *client = atomic_ptr_get(&_client);
+        if (NULL == client)
+        {
+            LOG_ERR("Not connected to cloud");
+            return -ENOTCONN;
+        }
+
+        status = golioth_gateway_device_cert_set(client, context->buf, context->len, 5);
         if (status != GOLIOTH_OK)
         {
             LOG_ERR("Failed to finish device cert: %d", status);
             return -EIO;
         }
+
+        if (cacheable)
+        {
+            cert_cache_insert(digest);
+        }
+    }
+
+    return 0;
+}
+
+int pouch_gateway_device_cert_finish(struct pouch_gateway_device_cert_context *context)
+{
+    int err = device_cert_upload(context);
+    if (err)
+    {
+        return err;
     }
 
     pouch_gateway_device_cert_abort(context);
@@ -94,6 +147,39 @@ int pouch_gateway_device_cert_finish(struct pouch_gateway_device_cert_context *c
     return 0;
 }
 
+static void device_cert_upload_work_handler(struct k_work *work)
+{
+    struct pouch_gateway_device_cert_context *context =
+        CONTAINER_OF(work, struct pouch_gateway_device_cert_context, work);
+    int64_t start = k_uptime_get();
+
+    int err = device_cert_upload(context);
+
+    LOG_DBG("Device cert upload took %lld ms", k_uptime_get() - start);
+
+    context->done_cb(err, context->done_cb_arg);
+
+    pouch_gateway_device_cert_abort(context);
+}
+
+int pouch_gateway_device_cert_finish_async(struct pouch_gateway_device_cert_context *context,
+                                           pouch_gateway_device_cert_done_cb done_cb,
+                                           void *done_cb_arg)
+{
+    context->done_cb = done_cb;
+    context->done_cb_arg = done_cb_arg;
+    k_work_init(&context->work, device_cert_upload_work_handler);
+
+    int ret = k_work_submit_to_queue(&device_cert_work_q, &context->work);
+    if (ret < 0)
+    {
+        LOG_ERR("Failed to submit device cert upload: %d", ret);
+        return ret;
+    }
+
+    return 0;
+}
+
 struct pouch_gateway_server_cert_context *pouch_gateway_server_cert_start(void)
 {
     struct pouch_gateway_server_cert_context *context =
@@ -115,34 +201,167 @@ bool pouch_gateway_server_cert_is_newest(const struct pouch_gateway_server_cert_
     return context->id == atomic_get(&server_crt_id);
 }
 
-static int server_crt_update(size_t len)
+static int device_cert_work_q_init(void)
+{
+    k_work_queue_start(&device_cert_work_q,
+                       device_cert_work_q_stack,
+                       K_THREAD_STACK_SIZEOF(device_cert_work_q_stack),
+                       K_LOWEST_APPLICATION_THREAD_PRIO,
+                       NULL);
+    k_thread_name_set(&device_cert_work_q.thread, "device_cert");
+
+    return 0;
+}
+
+SYS_INIT(device_cert_work_q_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+static int server_crt_parse_serial(const uint8_t *buf,
+                                  size_t len,
+                                  uint8_t *serial,
+                                  size_t *serial_len)
 {
     mbedtls_x509_crt cert_chain;
+    int err = 0;
 
     mbedtls_x509_crt_init(&cert_chain);
 
-    int ret = mbedtls_x509_crt_parse(&cert_chain, server_crt_buf, len);
+    int ret = mbedtls_x509_crt_parse(&cert_chain, buf, len);
     if (ret < 0)
     {
         LOG_ERR("Failed to parse certificate: 0x%x", -ret);
-        mbedtls_x509_crt_free(&cert_chain);
-
-        return -EIO;
+        err = -EIO;
+        goto finish;
     }
 
     LOG_HEXDUMP_DBG(cert_chain.serial.p, cert_chain.serial.len, "cert_chain.serial");
 
-    memcpy(server_crt_serial, cert_chain.serial.p, cert_chain.serial.len);
-    atomic_set(&server_crt_serial_len, cert_chain.serial.len);
+    if (cert_chain.serial.len > CERT_SERIAL_MAXLEN)
+    {
+        LOG_ERR("Certificate serial too long: %zu", cert_chain.serial.len);
+        err = -EINVAL;
+        goto finish;
+    }
+
+    memcpy(serial, cert_chain.serial.p, cert_chain.serial.len);
+    *serial_len = cert_chain.serial.len;
+
+finish:
+    mbedtls_x509_crt_free(&cert_chain);
+
+    return err;
+}
+
+static void server_crt_set(const uint8_t *buf,
+                           size_t len,
+                           const uint8_t *serial,
+                           size_t serial_len)
+{
+    if (buf != server_crt_buf)
+    {
+        memcpy(server_crt_buf, buf, len);
+    }
+
+    memcpy(server_crt_serial, serial, serial_len);
+    atomic_set(&server_crt_serial_len, serial_len);
 
     atomic_set(&server_crt_len, len);
     atomic_inc(&server_crt_id);
+}
 
-    mbedtls_x509_crt_free(&cert_chain);
+#ifdef CONFIG_POUCH_GATEWAY_SERVER_CERT_PERSIST
+
+#define SERVER_CERT_SETTINGS_KEY "pouch_gw/srv_crt"
+
+static int server_crt_load_cb(const char *key,
+                              size_t len,
+                              settings_read_cb read_cb,
+                              void *cb_arg,
+                              void *param)
+{
+    size_t *loaded_len = param;
+
+    if (key != NULL || len > sizeof(server_crt_buf))
+    {
+        return 0;
+    }
+
+    ssize_t ret = read_cb(cb_arg, server_crt_buf, len);
+    if (ret == len)
+    {
+        *loaded_len = len;
+    }
+
+    return 0;
+}
+
+static size_t server_crt_load(void)
+{
+    size_t len = 0;
 
+    int err = settings_subsys_init();
+    if (err)
+    {
+        LOG_ERR("Failed to initialize settings: %d", err);
+        return 0;
+    }
+
+    err = settings_load_subtree_direct(SERVER_CERT_SETTINGS_KEY, server_crt_load_cb, &len);
+    if (err)
+    {
+        LOG_ERR("Failed to load server certificate: %d", err);
+        return 0;
+    }
+
+    return len;
+}
+
+static void server_crt_store(void)
+{
+    int err = settings_save_one(SERVER_CERT_SETTINGS_KEY,
+                                server_crt_buf,
+                                atomic_get(&server_crt_len));
+    if (err)
+    {
+        LOG_ERR("Failed to store server certificate: %d", err);
+    }
+}
+
+#else /* CONFIG_POUCH_GATEWAY_SERVER_CERT_PERSIST */
+
+static inline size_t server_crt_load(void)
+{
     return 0;
 }
 
+static inline void server_crt_store(void) {}
+
+#endif /* CONFIG_POUCH_GATEWAY_SERVER_CERT_PERSIST */
+
+/* Replace the current server certificate, unless it has the same serial. Returns true if the
+   certificate was replaced. */
+static bool server_crt_refresh(const uint8_t *buf, size_t len)
+{
+    uint8_t serial[CERT_SERIAL_MAXLEN];
+    size_t serial_len;
+
+    int err = server_crt_parse_serial(buf, len, serial, &serial_len);
+    if (err)
+    {
+        return false;
+    }
+
+    if (atomic_get(&server_crt_len) > 0 && atomic_get(&server_crt_serial_len) == serial_len
+        && 0 == memcmp(server_crt_serial, serial, serial_len))
+    {
+        LOG_INF("Server certificate unchanged");
+        return false;
+    }
+
+    server_crt_set(buf, len, serial, serial_len);
+
+    return true;
+}
+
 bool pouch_gateway_server_cert_is_complete(const struct pouch_gateway_server_cert_context *context)
 {
     return context->offset >= atomic_get(&server_crt_len);
@@ -195,23 +414,60 @@ void pouch_gateway_server_cert_abort(struct pouch_gateway_server_cert_context *c
     free(context);
 }
 
+void pouch_gateway_cert_module_init(void)
+{
+    uint8_t serial[CERT_SERIAL_MAXLEN];
+    size_t serial_len;
+
+    if (IS_ENABLED(CONFIG_POUCH_GATEWAY_DEVICE_CERT_CACHE))
+    {
+        cert_cache_init();
+    }
+
+    /* Nothing reads the buffer yet, so the certificate can be loaded in place */
+    size_t len = server_crt_load();
+    if (0 == len)
+    {
+        return;
+    }
+
+    int err = server_crt_parse_serial(server_crt_buf, len, serial, &serial_len);
+    if (err)
+    {
+        LOG_WRN("Ignoring stored server certificate");
+        return;
+    }
+
+    server_crt_set(server_crt_buf, len, serial, serial_len);
+
+    LOG_INF("Loaded stored server cert");
+}
+
 void pouch_gateway_cert_module_on_connected(struct golioth_client *client)
 {
     enum golioth_status status;
 
-    _client = client;
+    atomic_ptr_set(&_client, client);
 
     if (IS_ENABLED(CONFIG_POUCH_GATEWAY_CLOUD))
     {
-        size_t len = sizeof(server_crt_buf);
-        status = golioth_gateway_server_cert_get(client, server_crt_buf, &len);
+        /* Download into a separate buffer, so that nodes can keep reading
+           the current certificate if it turns out to be unchanged. Only the
+           main thread downloads, so the buffer needs no locking. */
+        static uint8_t buf[sizeof(server_crt_buf)];
+        size_t len = sizeof(buf);
+
+        status = golioth_gateway_server_cert_get(client, buf, &len);
         if (status != GOLIOTH_OK)
         {
             LOG_ERR("Failed to download server certificate: %d", status);
             return;
         }
 
-        server_crt_update(len);
+        if (server_crt_refresh(buf, len))
+        {
+            server_crt_store();
+        }
     }
     else if (IS_ENABLED(CONFIG_POUCH_GATEWAY_SERVER_CERT_BUILTIN))
     {
@@ -219,8 +475,7 @@ void pouch_gateway_cert_module_on_connected(struct golioth_client *client)
 #include "pouch_gateway_server.pem.inc"
         };
 
-        memcpy(server_crt_buf, server_crt_offline, sizeof(server_crt_offline));
-        server_crt_update(sizeof(server_crt_offline));
+        server_crt_refresh(server_crt_offline, sizeof(server_crt_offline));
 
         LOG_INF("Loaded builtin server cert");
     }
@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <psa/crypto.h>
+
+#include <zephyr/kernel.h>
+
+#ifdef CONFIG_POUCH_GATEWAY_DEVICE_CERT_CACHE_PERSIST
+#include <zephyr/settings/settings.h>
+#endif
+
+#include <pouch_gateway/cert.h>
+
+#include "cert_cache.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(cert_cache, CONFIG_POUCH_GATEWAY_LOG_LEVEL);
+
+struct cert_cache_entry
+{
+    uint8_t digest[CERT_CACHE_DIGEST_LEN];
+    int64_t uploaded_at;
+    int64_t last_used;
+    bool valid;
+};
+
+static struct cert_cache_entry entries[CONFIG_POUCH_GATEWAY_DEVICE_CERT_CACHE_SIZE];
+static K_MUTEX_DEFINE(cache_lock);
+static uint32_t cache_hits;
+static uint32_t cache_misses;
+
+static bool entry_is_expired(const struct cert_cache_entry *entry, int64_t now)
+{
+    return now - entry->uploaded_at > CONFIG_POUCH_GATEWAY_DEVICE_CERT_CACHE_TTL * MSEC_PER_SEC;
+}
+
+#ifdef CONFIG_POUCH_GATEWAY_DEVICE_CERT_CACHE_PERSIST
+
+#define CERT_CACHE_SETTINGS_KEY "pouch_gw/crt_cache"
+
+/* The age of each entry is stored with its digest, so that the lifetime
+   continues after a reboot. Time spent powered off is not counted. */
+struct cert_cache_record
+{
+    uint8_t digest[CERT_CACHE_DIGEST_LEN];
+    uint32_t age_s;
+};
+
+static struct cert_cache_record stored_records[CONFIG_POUCH_GATEWAY_DEVICE_CERT_CACHE_SIZE];
+
+static void cert_cache_store_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(cert_cache_store_work, cert_cache_store_work_handler);
+
+static int cert_cache_load_cb(const char *key,
+                              size_t len,
+                              settings_read_cb read_cb,
+                              void *cb_arg,
+                              void *param)
+{
+    if (key != NULL || len > sizeof(stored_records) || len % sizeof(struct cert_cache_record))
+    {
+        return 0;
+    }
+
+    ssize_t ret = read_cb(cb_arg, stored_records, len);
+    if (ret != len)
+    {
+        return 0;
+    }
+
+    int64_t now = k_uptime_get();
+
+    for (size_t i = 0; i < len / sizeof(struct cert_cache_record); i++)
+    {
+        memcpy(entries[i].digest, stored_records[i].digest, CERT_CACHE_DIGEST_LEN);
+        entries[i].uploaded_at = now - (int64_t) stored_records[i].age_s * MSEC_PER_SEC;
+        entries[i].last_used = now;
+        entries[i].valid = !entry_is_expired(&entries[i], now);
+    }
+
+    LOG_DBG("Loaded %zu cached certificate digests", len / sizeof(struct cert_cache_record));
+
+    return 0;
+}
+
+/* Changes within an interval are stored together, to limit flash wear */
+static void cert_cache_store(void)
+{
+    k_work_schedule(&cert_cache_store_work,
+                    K_SECONDS(CONFIG_POUCH_GATEWAY_DEVICE_CERT_CACHE_PERSIST_INTERVAL));
+}
+
+static void cert_cache_load(void)
+{
+    int err = settings_subsys_init();
+    if (err)
+    {
+        LOG_ERR("Failed to initialize settings: %d", err);
+        return;
+    }
+
+    err = settings_load_subtree_direct(CERT_CACHE_SETTINGS_KEY, cert_cache_load_cb, NULL);
+    if (err)
+    {
+        LOG_ERR("Failed to load certificate cache: %d", err);
+    }
+
+    /* Keep counting the age of the loaded entries */
+    for (size_t i = 0; i < ARRAY_SIZE(entries); i++)
+    {
+        if (entries[i].valid)
+        {
+            cert_cache_store();
+            break;
+        }
+    }
+}
+
+static void cert_cache_store_work_handler(struct k_work *work)
+{
+    int64_t now = k_uptime_get();
+    size_t count = 0;
+
+    k_mutex_lock(&cache_lock, K_FOREVER);
+
+    for (size_t i = 0; i < ARRAY_SIZE(entries); i++)
+    {
+        if (entries[i].valid && !entry_is_expired(&entries[i], now))
+        {
+            memcpy(stored_records[count].digest, entries[i].digest, CERT_CACHE_DIGEST_LEN);
+            stored_records[count].age_s = (now - entries[i].uploaded_at) / MSEC_PER_SEC;
+            count++;
+        }
+    }
+
+    /* Store the ages again later, until all entries have expired */
+    if (count > 0)
+    {
+        cert_cache_store();
+    }
+
+    k_mutex_unlock(&cache_lock);
+
+    /* Lookups need not wait for flash, as only this work uses the records */
+    int err = settings_save_one(CERT_CACHE_SETTINGS_KEY,
+                                stored_records,
+                                count * sizeof(struct cert_cache_record));
+    if (err)
+    {
+        LOG_ERR("Failed to store certificate cache: %d", err);
+    }
+}
+
+#else /* CONFIG_POUCH_GATEWAY_DEVICE_CERT_CACHE_PERSIST */
+
+static inline void cert_cache_load(void) {}
+
+static inline void cert_cache_store(void) {}
+
+#endif /* CONFIG_POUCH_GATEWAY_DEVICE_CERT_CACHE_PERSIST */
+
+void cert_cache_init(void)
+{
+    psa_status_t status = psa_crypto_init();
+    if (status != PSA_SUCCESS)
+    {
+        LOG_ERR("Failed to initialize PSA crypto: %d", status);
+    }
+
+    k_mutex_lock(&cache_lock, K_FOREVER);
+    cert_cache_load();
+    k_mutex_unlock(&cache_lock);
+}
+
+int cert_cache_digest(const void *cert, size_t len, uint8_t *digest)
+{
+    size_t digest_len;
+
+    psa_status_t status =
+        psa_hash_compute(PSA_ALG_SHA_256, cert, len, digest, CERT_CACHE_DIGEST_LEN, &digest_len);
+    if (status != PSA_SUCCESS)
+    {
+        LOG_ERR("Failed to hash certificate: %d", status);
+        return -EIO;
+    }
+
+    return 0;
+}
+
+bool cert_cache_lookup(const uint8_t *digest)
+{
+    int64_t now = k_uptime_get();
+    bool hit = false;
+
+    k_mutex_lock(&cache_lock, K_FOREVER);
+
+    for (size_t i = 0; i < ARRAY_SIZE(entries); i++)
+    {
+        struct cert_cache_entry *entry = &entries[i];
+
+        if (!entry->valid || 0 != memcmp(entry->digest, digest, CERT_CACHE_DIGEST_LEN))
+        {
+            continue;
+        }
+
+        if (entry_is_expired(entry, now))
+        {
+            entry->valid = false;
+            break;
+        }
+
+        entry->last_used = now;
+        hit = true;
+        break;
+    }
+
+    if (hit)
+    {
+        cache_hits++;
+    }
+    else
+    {
+        cache_misses++;
+    }
+
+    k_mutex_unlock(&cache_lock);
+
+    return hit;
+}
+
+void cert_cache_insert(const uint8_t *digest)
+{
+    int64_t now = k_uptime_get();
+    struct cert_cache_entry *victim = &entries[0];
+
+    k_mutex_lock(&cache_lock, K_FOREVER);
+
+    /* Reuse the entry of the same certificate, a free entry or the least
+       recently used one, in that order of preference */
+    for (size_t i = 0; i < ARRAY_SIZE(entries); i++)
+    {
+        struct cert_cache_entry *entry = &entries[i];
+
+        if (entry->valid && 0 == memcmp(entry->digest, digest, CERT_CACHE_DIGEST_LEN))
+        {
+            victim = entry;
+            break;
+        }
+
+        if (!victim->valid)
+        {
+            continue;
+        }
+
+        if (!entry->valid || entry->last_used < victim->last_used)
+        {
+            victim = entry;
+        }
+    }
+
+    memcpy(victim->digest, digest, CERT_CACHE_DIGEST_LEN);
+    victim->uploaded_at = now;
+    victim->last_used = now;
+    victim->valid = true;
+
+    cert_cache_store();
+
+    k_mutex_unlock(&cache_lock);
+}
+
+void pouch_gateway_device_cert_cache_stats_get(struct pouch_gateway_device_cert_cache_stats *stats)
+{
+    k_mutex_lock(&cache_lock, K_FOREVER);
+
+    stats->hits = cache_hits;
+    stats->misses = cache_misses;
+    stats->entries = 0;
+
+    for (size_t i = 0; i < ARRAY_SIZE(entries); i++)
+    {
+        if (entries[i].valid)
+        {
+            stats->entries++;
+        }
+    }
+
+    k_mutex_unlock(&cache_lock);
+}
@@ -0,0 +1,18 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CERT_CACHE_DIGEST_LEN 32
+
+void cert_cache_init(void);
+int cert_cache_digest(const void *cert, size_t len, uint8_t *digest);
+bool cert_cache_lookup(const uint8_t *digest);
+void cert_cache_insert(const uint8_t *digest);
@@ -4,7 +4,7 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
-#include <stdlib.h>
+#include <string.h>
 
 #include <zephyr/kernel.h>
 #include <zephyr/sys/atomic.h>
@@ -23,6 +23,8 @@ enum
     DOWNLINK_FLAG_TRANSPORT_ABORTED,
     DOWNLINK_FLAG_TRANSPORT_WAITING,
     DOWNLINK_FLAG_COAP_ERROR,
+    DOWNLINK_FLAG_CLOUD_ENDED,
+    DOWNLINK_FLAG_NO_MORE_DATA,
     DOWNLINK_FLAG_COUNT,
 };
 
@@ -33,19 +35,145 @@ struct pouch_gateway_downlink_context
     struct k_fifo block_queue;
     struct block *current_block;
     size_t offset;
+    struct pouch_gateway_downlink_stats stats;
     ATOMIC_DEFINE(flags, DOWNLINK_FLAG_COUNT);
 };
 
 static struct golioth_client *_client;
 
-static void flush_block_queue(struct k_fifo *queue)
+/* The quota admits one downlink for every
+   CONFIG_POUCH_GATEWAY_DOWNLINK_MIN_BLOCKS blocks in the pool */
+#define DOWNLINK_MAX_OPEN \
+    (CONFIG_POUCH_GATEWAY_NUM_BLOCKS / CONFIG_POUCH_GATEWAY_DOWNLINK_MIN_BLOCKS)
+
+K_MEM_SLAB_DEFINE_STATIC(downlink_slab,
+                         sizeof(struct pouch_gateway_downlink_context),
+                         DOWNLINK_MAX_OPEN,
+                         8);
+
+/* Every open downlink is guaranteed CONFIG_POUCH_GATEWAY_DOWNLINK_MIN_BLOCKS
+   blocks, and downlinks are refused once that no longer holds. Whatever is
+   left in the pool is shared by all downlinks. The lock also serializes
+   the cloud callbacks with the transport waiting for or aborting them. */
+static K_MUTEX_DEFINE(quota_lock);
+static size_t open_contexts;
+static size_t shared_used;
+/* Blocks taken out of their context, that stay in the pool until sent */
+static size_t blocks_sending;
+
+static size_t shared_capacity(void)
 {
-    struct block *block = k_fifo_get(queue, K_NO_WAIT);
+    size_t unavailable = open_contexts * CONFIG_POUCH_GATEWAY_DOWNLINK_MIN_BLOCKS + blocks_sending;
+
+    return unavailable < CONFIG_POUCH_GATEWAY_NUM_BLOCKS
+        ? CONFIG_POUCH_GATEWAY_NUM_BLOCKS - unavailable
+        : 0;
+}
+
+/* Reserve the guaranteed blocks of a new downlink. Fails if the blocks are
+   taken, either reserved by other downlinks or borrowed from the shared
+   part of the pool. */
+static bool quota_open(void)
+{
+    bool opened = false;
+
+    k_mutex_lock(&quota_lock, K_FOREVER);
+    if (shared_used + CONFIG_POUCH_GATEWAY_DOWNLINK_MIN_BLOCKS <= shared_capacity())
+    {
+        open_contexts++;
+        opened = true;
+    }
+    k_mutex_unlock(&quota_lock);
+
+    return opened;
+}
+
+static void quota_close(void)
+{
+    k_mutex_lock(&quota_lock, K_FOREVER);
+    open_contexts--;
+    k_mutex_unlock(&quota_lock);
+}
+
+/* Must be called with quota_lock held */
+static bool quota_take(struct pouch_gateway_downlink_context *downlink)
+{
+    if (downlink->stats.blocks_used < CONFIG_POUCH_GATEWAY_DOWNLINK_MIN_BLOCKS)
+    {
+        downlink->stats.blocks_used++;
+        return true;
+    }
+
+    if (shared_used < shared_capacity())
+    {
+        shared_used++;
+        downlink->stats.blocks_used++;
+        return true;
+    }
+
+    return false;
+}
+
+/* Must be called with quota_lock held */
+static void quota_give(struct pouch_gateway_downlink_context *downlink)
+{
+    if (downlink->stats.blocks_used > CONFIG_POUCH_GATEWAY_DOWNLINK_MIN_BLOCKS)
+    {
+        shared_used--;
+    }
+    downlink->stats.blocks_used--;
+}
+
+/* Must be called with quota_lock held */
+static bool enqueue_block(struct pouch_gateway_downlink_context *downlink,
+                          const uint8_t *data,
+                          size_t len,
+                          bool is_last)
+{
+    if (!quota_take(downlink))
+    {
+        return false;
+    }
+
+    struct block *block = block_alloc(downlink, K_NO_WAIT);
+    if (NULL == block)
+    {
+        quota_give(downlink);
+        return false;
+    }
+
+    downlink->stats.blocks_total++;
+    downlink->stats.blocks_peak = MAX(downlink->stats.blocks_peak, downlink->stats.blocks_used);
+
+    block_append(block, data, len);
+
+    if (is_last)
+    {
+        block_mark_last(block);
+    }
+    k_fifo_put(&downlink->block_queue, block);
+
+    return true;
+}
+
+static void downlink_block_free(struct pouch_gateway_downlink_context *downlink,
+                                struct block *block)
+{
+    block_free(block);
+
+    k_mutex_lock(&quota_lock, K_FOREVER);
+    quota_give(downlink);
+    k_mutex_unlock(&quota_lock);
+}
+
+static void flush_block_queue(struct pouch_gateway_downlink_context *downlink)
+{
+    struct block *block = k_fifo_get(&downlink->block_queue, K_NO_WAIT);
     while (NULL != block)
     {
-        block_free(block);
+        downlink_block_free(downlink, block);
 
-        block = k_fifo_get(queue, K_NO_WAIT);
+        block = k_fifo_get(&downlink->block_queue, K_NO_WAIT);
     }
 }
 
@@ -55,42 +183,101 @@ enum golioth_status pouch_gateway_downlink_block_cb(const uint8_t *data,
                                                     void *arg)
 {
     struct pouch_gateway_downlink_context *downlink = arg;
+    pouch_gateway_downlink_data_available_cb data_available_cb = NULL;
+    void *cb_arg = NULL;
+
+    k_mutex_lock(&quota_lock, K_FOREVER);
 
     if (atomic_test_bit(downlink->flags, DOWNLINK_FLAG_TRANSPORT_ABORTED))
     {
+        k_mutex_unlock(&quota_lock);
         return GOLIOTH_ERR_NACK;
     }
 
-    struct block *block = block_alloc(NULL, K_SECONDS(CONFIG_POUCH_GATEWAY_DOWNLINK_BLOCK_TIMEOUT));
-    if (NULL == block)
+    /* This runs on the client thread shared by all nodes, so it never
+       waits for a slow node to free blocks. The blockwise transfer cannot
+       be paused, so a block that does not fit ends it with an error, which
+       the transport reports once it has sent the queued blocks. */
+    if (!enqueue_block(downlink, data, len, is_last))
     {
-        LOG_ERR("Failed to allocate block");
+        downlink->stats.blocks_refused++;
+        k_mutex_unlock(&quota_lock);
+
+        LOG_ERR("Node is not consuming downlink data, refusing block");
         return GOLIOTH_ERR_MEM_ALLOC;
     }
 
-    block_append(block, data, len);
-
+    /* The transport may close the context as soon as it has consumed
+       the last block, so the context is not touched after unlocking */
     if (is_last)
     {
-        block_mark_last(block);
+        atomic_set_bit(downlink->flags, DOWNLINK_FLAG_CLOUD_ENDED);
     }
-    k_fifo_put(&downlink->block_queue, block);
 
     if (NULL == downlink->current_block
         && atomic_test_and_clear_bit(downlink->flags, DOWNLINK_FLAG_TRANSPORT_WAITING))
     {
-        downlink->data_available_cb(downlink->cb_arg);
+        data_available_cb = downlink->data_available_cb;
+        cb_arg = downlink->cb_arg;
+    }
+
+    k_mutex_unlock(&quota_lock);
+
+    if (NULL != data_available_cb)
+    {
+        data_available_cb(cb_arg);
     }
 
     return GOLIOTH_OK;
 }
 
+/* Ends the downlink from the cloud side, with the given flag telling the
+   transport how it ended once the block queue is empty */
+static void cloud_end(struct pouch_gateway_downlink_context *downlink, int flag)
+{
+    pouch_gateway_downlink_data_available_cb data_available_cb = NULL;
+    void *cb_arg = NULL;
+    bool close = false;
+
+    k_mutex_lock(&quota_lock, K_FOREVER);
+
+    /* If transport already aborted, close downlink */
+
+    if (atomic_test_bit(downlink->flags, DOWNLINK_FLAG_TRANSPORT_ABORTED))
+    {
+        close = true;
+    }
+    else
+    {
+        atomic_set_bit(downlink->flags, flag);
+        atomic_set_bit(downlink->flags, DOWNLINK_FLAG_CLOUD_ENDED);
+
+        /* If transport is waiting for a block, kick it */
+
+        if (NULL == downlink->current_block
+            && atomic_test_and_clear_bit(downlink->flags, DOWNLINK_FLAG_TRANSPORT_WAITING))
+        {
+            data_available_cb = downlink->data_available_cb;
+            cb_arg = downlink->cb_arg;
+        }
+    }
+
+    k_mutex_unlock(&quota_lock);
+
+    if (close)
+    {
+        pouch_gateway_downlink_close(downlink);
+    }
+    else if (NULL != data_available_cb)
+    {
+        data_available_cb(cb_arg);
+    }
+}
+
 void pouch_gateway_downlink_end_cb(enum golioth_status status,
                                    const struct golioth_coap_rsp_code *coap_rsp_code,
                                    void *arg)
 {
-    struct pouch_gateway_downlink_context *downlink = arg;
-
     if (GOLIOTH_OK != status)
     {
         LOG_ERR("Downlink ending due to error %d", status);
@@ -99,37 +286,36 @@ void pouch_gateway_downlink_end_cb(enum golioth_status status,
             LOG_ERR("CoAP error: %d.%02d", coap_rsp_code->code_class, coap_rsp_code->code_detail);
         }
 
-        /* If transport already aborted, close downlink */
-
-        if (atomic_test_bit(downlink->flags, DOWNLINK_FLAG_TRANSPORT_ABORTED))
-        {
-            pouch_gateway_downlink_close(downlink);
-        }
-        else
-        {
-            atomic_set_bit(downlink->flags, DOWNLINK_FLAG_COAP_ERROR);
-
-            /* If transport is waiting for a block, kick it */
-
-            if (NULL == downlink->current_block
-                && atomic_test_and_clear_bit(downlink->flags, DOWNLINK_FLAG_TRANSPORT_WAITING))
-            {
-                downlink->data_available_cb(downlink->cb_arg);
-            }
-        }
+        cloud_end(arg, DOWNLINK_FLAG_COAP_ERROR);
     }
 }
 
+void pouch_gateway_downlink_finish(struct pouch_gateway_downlink_context *downlink)
+{
+    cloud_end(downlink, DOWNLINK_FLAG_NO_MORE_DATA);
+}
+
 struct pouch_gateway_downlink_context *pouch_gateway_downlink_open(
     pouch_gateway_downlink_data_available_cb data_available_cb,
     void *cb_arg)
 {
     LOG_INF("Starting downlink");
 
-    struct pouch_gateway_downlink_context *downlink =
-        malloc(sizeof(struct pouch_gateway_downlink_context));
+    if (!quota_open())
+    {
+        LOG_WRN("Downlink buffer full");
+        return NULL;
+    }
+
+    struct pouch_gateway_downlink_context *downlink = NULL;
 
-    if (NULL != downlink)
+    /* Contexts are freed before their quota is given back, so the slab
+       holds one for every downlink the quota admits */
+    if (k_mem_slab_alloc(&downlink_slab, (void **) &downlink, K_NO_WAIT))
+    {
+        quota_close();
+    }
+    else
     {
         downlink->data_available_cb = data_available_cb;
         downlink->cb_arg = cb_arg;
@@ -138,79 +324,220 @@ struct pouch_gateway_downlink_context *pouch_gateway_downlink_open(
         atomic_clear_bit(downlink->flags, DOWNLINK_FLAG_COMPLETE);
         atomic_clear_bit(downlink->flags, DOWNLINK_FLAG_TRANSPORT_ABORTED);
         atomic_clear_bit(downlink->flags, DOWNLINK_FLAG_COAP_ERROR);
+        atomic_clear_bit(downlink->flags, DOWNLINK_FLAG_CLOUD_ENDED);
+        atomic_clear_bit(downlink->flags, DOWNLINK_FLAG_NO_MORE_DATA);
         atomic_set_bit(downlink->flags, DOWNLINK_FLAG_TRANSPORT_WAITING);
+        memset(&downlink->stats, 0, sizeof(downlink->stats));
         k_fifo_init(&downlink->block_queue);
     }
 
     return downlink;
 }
 
-int pouch_gateway_downlink_get_data(struct pouch_gateway_downlink_context *downlink,
-                                    void *dst,
-                                    size_t *dst_len,
-                                    bool *is_last)
+int pouch_gateway_downlink_borrow(struct pouch_gateway_downlink_context *downlink,
+                                  const void **data,
+                                  size_t *len,
+                                  bool *is_last)
 {
+    *data = NULL;
     *is_last = false;
+    *len = 0;
 
     if (pouch_gateway_downlink_is_complete(downlink))
     {
         return -ENODATA;
     }
 
-    size_t total_bytes_copied = 0;
-
-    while (*dst_len)
+    if (NULL == downlink->current_block)
     {
+        downlink->current_block = k_fifo_get(&downlink->block_queue, K_NO_WAIT);
         if (NULL == downlink->current_block)
         {
+            int ret = -EAGAIN;
+
+            /* Checked under the lock that the cloud callbacks hold, so that
+               a block arriving now is not missed */
+            k_mutex_lock(&quota_lock, K_FOREVER);
+
             downlink->current_block = k_fifo_get(&downlink->block_queue, K_NO_WAIT);
+            if (NULL != downlink->current_block)
+            {
+                ret = 0;
+            }
+            else if (atomic_test_bit(downlink->flags, DOWNLINK_FLAG_COAP_ERROR))
+            {
+                /* The data received so far is not the whole downlink,
+                   so it must not be passed off as complete */
+                ret = -EIO;
+            }
+            else if (atomic_test_bit(downlink->flags, DOWNLINK_FLAG_NO_MORE_DATA))
+            {
+                *is_last = true;
+                atomic_set_bit(downlink->flags, DOWNLINK_FLAG_COMPLETE);
+                ret = 0;
+            }
+            else
+            {
+                /* We could not provide any data to the client, so we will
+                   notify them the next time we receive a block */
+                atomic_set_bit(downlink->flags, DOWNLINK_FLAG_TRANSPORT_WAITING);
+            }
+
+            k_mutex_unlock(&quota_lock);
+
             if (NULL == downlink->current_block)
             {
-                *dst_len = total_bytes_copied;
-                if (atomic_test_bit(downlink->flags, DOWNLINK_FLAG_COAP_ERROR))
-                {
-                    /* We previously received a CoAP error and now the block queue is empty */
-                    *is_last = true;
-                    atomic_set_bit(downlink->flags, DOWNLINK_FLAG_COMPLETE);
-                    return 0;
-                }
-                if (0 == *dst_len)
-                {
-                    /* We could not provide any data to the client, so we will
-                       notify them the next time we receive a block */
-                    atomic_set_bit(downlink->flags, DOWNLINK_FLAG_TRANSPORT_WAITING);
-                }
-                return -EAGAIN;
+                return ret;
             }
         }
+    }
+
+    *data = block_data(downlink->current_block) + downlink->offset;
+    *len = block_length(downlink->current_block) - downlink->offset;
+    *is_last = block_is_last(downlink->current_block);
+
+    return 0;
+}
+
+/* Moves on from the current block, once it has been consumed or taken */
+static void current_block_done(struct pouch_gateway_downlink_context *downlink, bool is_last)
+{
+    downlink->current_block = NULL;
+    downlink->offset = 0;
+
+    if (is_last)
+    {
+        atomic_set_bit(downlink->flags, DOWNLINK_FLAG_COMPLETE);
+    }
+}
+
+int pouch_gateway_downlink_release(struct pouch_gateway_downlink_context *downlink, size_t len)
+{
+    if (NULL == downlink->current_block)
+    {
+        return 0 == len ? 0 : -EINVAL;
+    }
+
+    if (len > block_length(downlink->current_block) - downlink->offset)
+    {
+        return -EINVAL;
+    }
+
+    downlink->offset += len;
+
+    if (downlink->offset == block_length(downlink->current_block))
+    {
+        bool is_last = block_is_last(downlink->current_block);
+
+        downlink_block_free(downlink, downlink->current_block);
+        current_block_done(downlink, is_last);
+    }
+
+    return 0;
+}
+
+bool pouch_gateway_downlink_data_ready(struct pouch_gateway_downlink_context *downlink)
+{
+    return NULL != downlink->current_block || !k_fifo_is_empty(&downlink->block_queue)
+        || atomic_test_bit(downlink->flags, DOWNLINK_FLAG_CLOUD_ENDED)
+        || pouch_gateway_downlink_is_complete(downlink);
+}
+
+int pouch_gateway_downlink_block_take(struct pouch_gateway_downlink_context *downlink,
+                                      size_t max_len,
+                                      struct pouch_gateway_downlink_block **block,
+                                      uint8_t **data,
+                                      size_t *len,
+                                      bool *is_last)
+{
+    const void *borrowed;
+
+    int ret = pouch_gateway_downlink_borrow(downlink, &borrowed, len, is_last);
+    if (ret)
+    {
+        return ret;
+    }
+
+    struct block *current = downlink->current_block;
+    if (NULL == current || 0 != downlink->offset || *len > max_len)
+    {
+        return -EMSGSIZE;
+    }
+
+    /* The block stays out of the pool until it has been sent, but no
+       longer counts against the context */
+    k_mutex_lock(&quota_lock, K_FOREVER);
+    quota_give(downlink);
+    blocks_sending++;
+    k_mutex_unlock(&quota_lock);
+
+    *block = (struct pouch_gateway_downlink_block *) current;
+    *data = block_headroom(current) + CONFIG_POUCH_GATEWAY_BLOCK_HEADROOM;
+
+    current_block_done(downlink, *is_last);
+
+    return 0;
+}
+
+void pouch_gateway_downlink_block_put(struct pouch_gateway_downlink_block *block)
+{
+    block_free((struct block *) block);
+
+    k_mutex_lock(&quota_lock, K_FOREVER);
+    blocks_sending--;
+    k_mutex_unlock(&quota_lock);
+}
+
+int pouch_gateway_downlink_get_data(struct pouch_gateway_downlink_context *downlink,
+                                    void *dst,
+                                    size_t *dst_len,
+                                    bool *is_last)
+{
+    size_t total_bytes_copied = 0;
+    int ret = 0;
+
+    *is_last = false;
+
+    while (total_bytes_copied < *dst_len)
+    {
+        const void *data;
+        size_t len;
+
+        /* Return what was copied rather than wait for more */
+        if (0 < total_bytes_copied && !pouch_gateway_downlink_data_ready(downlink))
+        {
+            break;
+        }
 
-        size_t bytes_to_copy =
-            MIN(*dst_len, block_length(downlink->current_block) - downlink->offset);
-        block_get(downlink->current_block, downlink->offset, dst, bytes_to_copy);
+        ret = pouch_gateway_downlink_borrow(downlink, &data, &len, is_last);
+        if (ret)
+        {
+            break;
+        }
 
-        downlink->offset += bytes_to_copy;
-        *dst_len -= bytes_to_copy;
-        dst = (void *) ((intptr_t) dst + bytes_to_copy);
+        size_t bytes_to_copy = MIN(*dst_len - total_bytes_copied, len);
+        memcpy((uint8_t *) dst + total_bytes_copied, data, bytes_to_copy);
         total_bytes_copied += bytes_to_copy;
 
-        if (block_length(downlink->current_block) == downlink->offset)
+        ret = pouch_gateway_downlink_release(downlink, bytes_to_copy);
+        if (ret)
         {
-            *is_last = block_is_last(downlink->current_block);
+            break;
+        }
 
-            block_free(downlink->current_block);
-            downlink->offset = 0;
-            downlink->current_block = k_fifo_get(&downlink->block_queue, K_NO_WAIT);
+        if (bytes_to_copy < len)
+        {
+            *is_last = false;
+        }
 
-            if (*is_last)
-            {
-                atomic_set_bit(downlink->flags, DOWNLINK_FLAG_COMPLETE);
-                break;
-            }
+        if (*is_last)
+        {
+            break;
         }
     }
 
     *dst_len = total_bytes_copied;
-    return 0;
+    return ret;
 }
 
 bool pouch_gateway_downlink_is_complete(const struct pouch_gateway_downlink_context *downlink)
@@ -220,14 +547,29 @@ bool pouch_gateway_downlink_is_complete(const struct pouch_gateway_downlink_cont
 
 void pouch_gateway_downlink_close(struct pouch_gateway_downlink_context *downlink)
 {
-    flush_block_queue(&downlink->block_queue);
+    flush_block_queue(downlink);
 
     if (NULL != downlink->current_block)
     {
-        block_free(downlink->current_block);
+        downlink_block_free(downlink, downlink->current_block);
     }
 
-    free(downlink);
+    LOG_DBG("Downlink used %u blocks (peak %u, refused %u)",
+            downlink->stats.blocks_total,
+            downlink->stats.blocks_peak,
+            downlink->stats.blocks_refused);
+
+    k_mem_slab_free(&downlink_slab, downlink);
+
+    quota_close();
+}
+
+void pouch_gateway_downlink_stats_get(const struct pouch_gateway_downlink_context *downlink,
+                                      struct pouch_gateway_downlink_stats *stats)
+{
+    k_mutex_lock(&quota_lock, K_FOREVER);
+    *stats = downlink->stats;
+    k_mutex_unlock(&quota_lock);
 }
 
 void pouch_gateway_downlink_abort(struct pouch_gateway_downlink_context *downlink)
@@ -237,11 +579,19 @@ void pouch_gateway_downlink_abort(struct pouch_gateway_downlink_context *downlin
     /* Downlink will be aborted after the current in flight CoAP
        block request is completed. */
 
+    k_mutex_lock(&quota_lock, K_FOREVER);
+
     atomic_set_bit(downlink->flags, DOWNLINK_FLAG_TRANSPORT_ABORTED);
 
-    /* If there are no more blocks, then just cleanup */
+    /* If there are no more blocks, or the cloud will not call back
+       anymore, then just cleanup */
 
-    if (pouch_gateway_downlink_is_complete(downlink))
+    bool close = pouch_gateway_downlink_is_complete(downlink)
+        || atomic_test_bit(downlink->flags, DOWNLINK_FLAG_CLOUD_ENDED);
+
+    k_mutex_unlock(&quota_lock);
+
+    if (close)
     {
         pouch_gateway_downlink_close(downlink);
     }
@@ -20,6 +20,7 @@ LOG_MODULE_REGISTER(info, CONFIG_POUCH_GATEWAY_LOG_LEVEL);
 #define INFO_MAX_SIZE 64
 
 #define INFO_FLAG_DEVICE_PROVISIONED BIT(0)
+#define INFO_FLAG_L2CAP_COC BIT(1)
 
 struct pouch_gateway_info_context
 {
@@ -63,7 +64,8 @@ void pouch_gateway_info_abort(struct pouch_gateway_info_context *context)
 
 int pouch_gateway_info_finish(struct pouch_gateway_info_context *context,
                               bool *server_cert_provisioned,
-                              bool *device_cert_provisioned)
+                              bool *device_cert_provisioned,
+                              bool *l2cap_coc_supported)
 {
     struct pouch_gatt_info info;
     uint8_t server_cert_serial_buf[CERT_SERIAL_MAXLEN];
@@ -86,6 +88,11 @@ int pouch_gateway_info_finish(struct pouch_gateway_info_context *context,
         *device_cert_provisioned = true;
     }
 
+    if (info.flags & INFO_FLAG_L2CAP_COC)
+    {
+        *l2cap_coc_supported = true;
+    }
+
     pouch_gateway_server_cert_get_serial(server_cert_serial_buf, &server_cert_serial.len);
 
     if (zcbor_compare_strings(&info.server_cert_snr, &server_cert_serial))
@@ -0,0 +1,659 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/fs/fs.h>
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+
+#include <pouch_gateway/uplink.h>
+
+#include "spool.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(spool, CONFIG_POUCH_GATEWAY_LOG_LEVEL);
+
+/* Each pouch is spooled to its own file, named after a sequence number.
+   The file carries a .part suffix until the pouch is complete, so that
+   only complete pouches are drained. A pouch that cannot be read back is
+   renamed with a .bad suffix, so that it neither blocks the drain nor is
+   lost.
+
+   Pouches vary in length and are drained as one blockwise upload each, so
+   a file per pouch rather than block-sized records in a shared log: a
+   rename commits a pouch atomically, a reset leaves at most some .part
+   files to delete, and a drained pouch is gone with one unlink, with no
+   log to compact. Allocation and wear leveling are left to the file
+   system. */
+#define SPOOL_PART_SUFFIX ".part"
+#define SPOOL_BAD_SUFFIX ".bad"
+#define SPOOL_PATH_MAX (sizeof(CONFIG_POUCH_GATEWAY_SPOOL_PATH) + 8 + sizeof(SPOOL_PART_SUFFIX) + 1)
+
+#define SPOOL_DRAIN_RETRY_DELAY K_MSEC(100)
+
+#define DRAIN_RESULT_PENDING -1
+
+struct spool_drain_slot
+{
+    struct fs_file_t file;
+    uint32_t seq;
+    size_t size;
+    size_t offset;
+    int64_t start_time;
+    struct pouch_gateway_uplink *uplink;
+    atomic_t result;
+    bool active;
+    bool read_failed;
+};
+
+enum spool_file_type
+{
+    SPOOL_FILE_INVALID,
+    SPOOL_FILE_COMPLETE,
+    SPOOL_FILE_PART,
+    SPOOL_FILE_BAD,
+};
+
+static K_MUTEX_DEFINE(spool_lock);
+static bool spool_initialized;
+static uint32_t next_seq;
+static struct pouch_gateway_spool_stats spool_stats;
+
+static struct spool_drain_slot drain_slots[CONFIG_POUCH_GATEWAY_SPOOL_DRAIN_CONCURRENCY];
+static atomic_t draining;
+
+static void drain_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(drain_work, drain_work_handler);
+
+/* File system access blocks on flash, so it runs on its own queue rather
+   than on the Bluetooth receive path */
+static K_THREAD_STACK_DEFINE(spool_work_q_stack, CONFIG_POUCH_GATEWAY_SPOOL_STACK_SIZE);
+static struct k_work_q spool_work_q;
+
+static void spool_path(char *path, uint32_t seq, const char *suffix)
+{
+    snprintk(path, SPOOL_PATH_MAX, CONFIG_POUCH_GATEWAY_SPOOL_PATH "/%08x%s", seq, suffix);
+}
+
+static enum spool_file_type spool_parse_name(const char *name, uint32_t *seq)
+{
+    char *end;
+
+    *seq = strtoul(name, &end, 16);
+    if (end != name + 8)
+    {
+        return SPOOL_FILE_INVALID;
+    }
+
+    if (*end == '\0')
+    {
+        return SPOOL_FILE_COMPLETE;
+    }
+
+    if (0 == strcmp(end, SPOOL_PART_SUFFIX))
+    {
+        return SPOOL_FILE_PART;
+    }
+
+    if (0 == strcmp(end, SPOOL_BAD_SUFFIX))
+    {
+        return SPOOL_FILE_BAD;
+    }
+
+    return SPOOL_FILE_INVALID;
+}
+
+/* Only runs on the spool work queue, which serializes it with the drain.
+   Must be called with spool_lock held. */
+static int spool_init(void)
+{
+    struct fs_dir_t dir;
+    struct fs_dirent entry;
+    struct fs_dirent stat;
+
+    if (spool_initialized)
+    {
+        return 0;
+    }
+
+    int err = fs_stat(CONFIG_POUCH_GATEWAY_SPOOL_PATH, &stat);
+    if (-ENOENT == err)
+    {
+        err = fs_mkdir(CONFIG_POUCH_GATEWAY_SPOOL_PATH);
+    }
+    if (err)
+    {
+        LOG_ERR("Failed to create spool directory: %d", err);
+        return err;
+    }
+
+    fs_dir_t_init(&dir);
+
+    err = fs_opendir(&dir, CONFIG_POUCH_GATEWAY_SPOOL_PATH);
+    if (err)
+    {
+        LOG_ERR("Failed to open spool directory: %d", err);
+        return err;
+    }
+
+    while (0 == fs_readdir(&dir, &entry) && entry.name[0] != '\0')
+    {
+        uint32_t seq;
+        enum spool_file_type type = SPOOL_FILE_INVALID;
+
+        if (entry.type == FS_DIR_ENTRY_FILE)
+        {
+            type = spool_parse_name(entry.name, &seq);
+        }
+
+        if (SPOOL_FILE_INVALID == type)
+        {
+            continue;
+        }
+
+        next_seq = MAX(next_seq, seq + 1);
+
+        if (SPOOL_FILE_PART == type)
+        {
+            /* Left behind by a pouch that was interrupted by a reset */
+            char path[SPOOL_PATH_MAX];
+
+            spool_path(path, seq, SPOOL_PART_SUFFIX);
+            fs_unlink(path);
+            continue;
+        }
+
+        if (SPOOL_FILE_BAD == type)
+        {
+            continue;
+        }
+
+        spool_stats.depth_files++;
+        spool_stats.depth_bytes += entry.size;
+    }
+
+    fs_closedir(&dir);
+
+    LOG_INF("Spool holds %u pouches (%llu bytes)",
+            spool_stats.depth_files,
+            (unsigned long long) spool_stats.depth_bytes);
+
+    spool_initialized = true;
+
+    return 0;
+}
+
+static void spool_init_work_handler(struct k_work *work)
+{
+    k_mutex_lock(&spool_lock, K_FOREVER);
+    spool_init();
+    k_mutex_unlock(&spool_lock);
+}
+
+static K_WORK_DEFINE(spool_init_work, spool_init_work_handler);
+
+int spool_writer_open(struct spool_writer *writer)
+{
+    int err = 0;
+
+    k_mutex_lock(&spool_lock, K_FOREVER);
+
+    if (!spool_initialized)
+    {
+        /* The file system may not have been mounted at boot */
+        LOG_WRN("Spool not ready");
+        k_work_submit_to_queue(&spool_work_q, &spool_init_work);
+        err = -EAGAIN;
+    }
+    else if (spool_stats.depth_files >= CONFIG_POUCH_GATEWAY_SPOOL_MAX_FILES)
+    {
+        LOG_WRN("Spool full");
+        err = -ENOSPC;
+    }
+    else
+    {
+        writer->seq = next_seq++;
+    }
+
+    k_mutex_unlock(&spool_lock);
+
+    if (err)
+    {
+        return err;
+    }
+
+    writer->len = 0;
+    writer->opened = false;
+
+    LOG_INF("Cloud unavailable, spooling pouch %u", writer->seq);
+
+    return 0;
+}
+
+static int spool_writer_create(struct spool_writer *writer)
+{
+    char path[SPOOL_PATH_MAX];
+
+    if (writer->opened)
+    {
+        return 0;
+    }
+
+    spool_path(path, writer->seq, SPOOL_PART_SUFFIX);
+
+    fs_file_t_init(&writer->file);
+    int err = fs_open(&writer->file, path, FS_O_CREATE | FS_O_WRITE | FS_O_TRUNC);
+    if (err)
+    {
+        LOG_ERR("Failed to open spool file: %d", err);
+        return err;
+    }
+
+    writer->opened = true;
+
+    return 0;
+}
+
+int spool_writer_append(struct spool_writer *writer, const void *data, size_t len)
+{
+    int err = spool_writer_create(writer);
+    if (err)
+    {
+        return err;
+    }
+
+    ssize_t ret = fs_write(&writer->file, data, len);
+    if (ret < 0)
+    {
+        LOG_ERR("Failed to write spool file: %d", (int) ret);
+        return ret;
+    }
+
+    if (ret != len)
+    {
+        return -ENOSPC;
+    }
+
+    writer->len += len;
+
+    return 0;
+}
+
+int spool_writer_commit(struct spool_writer *writer)
+{
+    char part_path[SPOOL_PATH_MAX];
+    char path[SPOOL_PATH_MAX];
+
+    int err = spool_writer_create(writer);
+    if (err)
+    {
+        return err;
+    }
+
+    writer->opened = false;
+
+    spool_path(part_path, writer->seq, SPOOL_PART_SUFFIX);
+    spool_path(path, writer->seq, "");
+
+    err = fs_close(&writer->file);
+    if (err)
+    {
+        LOG_ERR("Failed to close spool file: %d", err);
+        fs_unlink(part_path);
+        return err;
+    }
+
+    err = fs_rename(part_path, path);
+    if (err)
+    {
+        LOG_ERR("Failed to commit spool file: %d", err);
+        fs_unlink(part_path);
+        return err;
+    }
+
+    k_mutex_lock(&spool_lock, K_FOREVER);
+    spool_stats.depth_files++;
+    spool_stats.depth_bytes += writer->len;
+    spool_stats.spooled_files++;
+    k_mutex_unlock(&spool_lock);
+
+    LOG_INF("Spooled pouch %u (%zu bytes)", writer->seq, writer->len);
+
+    return 0;
+}
+
+void spool_writer_discard(struct spool_writer *writer)
+{
+    char path[SPOOL_PATH_MAX];
+
+    if (!writer->opened)
+    {
+        return;
+    }
+
+    writer->opened = false;
+    fs_close(&writer->file);
+
+    spool_path(path, writer->seq, SPOOL_PART_SUFFIX);
+    fs_unlink(path);
+}
+
+static void drain_end_cb(void *arg, enum pouch_gateway_uplink_result res)
+{
+    struct spool_drain_slot *slot = arg;
+
+    atomic_set(&slot->result, res);
+    k_work_reschedule_for_queue(&spool_work_q, &drain_work, K_NO_WAIT);
+}
+
+static void drain_writable_cb(void *arg)
+{
+    k_work_reschedule_for_queue(&spool_work_q, &drain_work, K_NO_WAIT);
+}
+
+static bool drain_slot_has_seq(uint32_t seq)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(drain_slots); i++)
+    {
+        if (drain_slots[i].active && drain_slots[i].seq == seq)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Find the oldest complete spool file that is not being drained */
+static int drain_next_file(uint32_t *seq, size_t *size)
+{
+    struct fs_dir_t dir;
+    struct fs_dirent entry;
+    bool found = false;
+
+    fs_dir_t_init(&dir);
+
+    int err = fs_opendir(&dir, CONFIG_POUCH_GATEWAY_SPOOL_PATH);
+    if (err)
+    {
+        return err;
+    }
+
+    while (0 == fs_readdir(&dir, &entry) && entry.name[0] != '\0')
+    {
+        uint32_t entry_seq;
+
+        if (entry.type != FS_DIR_ENTRY_FILE
+            || SPOOL_FILE_COMPLETE != spool_parse_name(entry.name, &entry_seq)
+            || drain_slot_has_seq(entry_seq))
+        {
+            continue;
+        }
+
+        if (!found || entry_seq < *seq)
+        {
+            *seq = entry_seq;
+            *size = entry.size;
+            found = true;
+        }
+    }
+
+    fs_closedir(&dir);
+
+    return found ? 0 : -ENOENT;
+}
+
+static int drain_slot_start(struct spool_drain_slot *slot)
+{
+    char path[SPOOL_PATH_MAX];
+
+    int err = drain_next_file(&slot->seq, &slot->size);
+    if (err)
+    {
+        return err;
+    }
+
+    spool_path(path, slot->seq, "");
+
+    fs_file_t_init(&slot->file);
+    err = fs_open(&slot->file, path, FS_O_READ);
+    if (err)
+    {
+        LOG_ERR("Failed to open spool file: %d", err);
+        return err;
+    }
+
+    atomic_set(&slot->result, DRAIN_RESULT_PENDING);
+    slot->offset = 0;
+    slot->read_failed = false;
+    slot->start_time = k_uptime_get();
+    slot->active = true;
+
+    /* The node that sent the pouch is gone, so the cloud response is
+       discarded */
+    slot->uplink = pouch_gateway_uplink_open_cloud(NULL, drain_end_cb, drain_writable_cb, slot);
+    if (NULL == slot->uplink)
+    {
+        fs_close(&slot->file);
+        slot->active = false;
+        return -EIO;
+    }
+
+    LOG_INF("Draining pouch %u (%zu bytes)", slot->seq, slot->size);
+
+    return 0;
+}
+
+/* Set a pouch that cannot be read aside, where it is kept for inspection
+   but no longer drained */
+static void drain_slot_quarantine(struct spool_drain_slot *slot)
+{
+    char path[SPOOL_PATH_MAX];
+    char bad_path[SPOOL_PATH_MAX];
+
+    spool_path(path, slot->seq, "");
+    spool_path(bad_path, slot->seq, SPOOL_BAD_SUFFIX);
+
+    int err = fs_rename(path, bad_path);
+    if (err)
+    {
+        /* Left in place, the file is retried with the next drain */
+        LOG_ERR("Failed to set aside pouch %u: %d", slot->seq, err);
+        atomic_clear(&draining);
+        return;
+    }
+
+    k_mutex_lock(&spool_lock, K_FOREVER);
+    spool_stats.depth_files--;
+    spool_stats.depth_bytes -= slot->size;
+    spool_stats.quarantined_files++;
+    k_mutex_unlock(&spool_lock);
+
+    LOG_ERR("Set aside unreadable pouch %u", slot->seq);
+}
+
+static void drain_slot_finish(struct spool_drain_slot *slot, int result)
+{
+    char path[SPOOL_PATH_MAX];
+
+    fs_close(&slot->file);
+    slot->active = false;
+
+    if (slot->read_failed)
+    {
+        drain_slot_quarantine(slot);
+        return;
+    }
+
+    if (POUCH_GATEWAY_UPLINK_SUCCESS != result)
+    {
+        LOG_WRN("Failed to drain pouch %u, pausing drain", slot->seq);
+        atomic_clear(&draining);
+        return;
+    }
+
+    spool_path(path, slot->seq, "");
+    fs_unlink(path);
+
+    int64_t elapsed = MAX(k_uptime_get() - slot->start_time, 1);
+
+    k_mutex_lock(&spool_lock, K_FOREVER);
+    spool_stats.depth_files--;
+    spool_stats.depth_bytes -= slot->size;
+    spool_stats.drained_files++;
+    spool_stats.drained_bytes += slot->size;
+    spool_stats.drain_rate = slot->size * MSEC_PER_SEC / elapsed;
+    k_mutex_unlock(&spool_lock);
+
+    LOG_INF("Drained pouch %u in %lld ms", slot->seq, elapsed);
+}
+
+/* Returns true if the slot needs to be retried later */
+static bool drain_slot_pump(struct spool_drain_slot *slot)
+{
+    /* Each read fills at most what is left of the reserved block, so the
+       uplink only needs room for data to continue */
+    while (slot->uplink != NULL
+           && !pouch_gateway_uplink_is_congested(slot->uplink, MIN(slot->size - slot->offset, 1)))
+    {
+        if (slot->offset >= slot->size)
+        {
+            /* The uplink frees itself once it ends */
+            pouch_gateway_uplink_close(slot->uplink);
+            slot->uplink = NULL;
+            break;
+        }
+
+        uint8_t *buf;
+        size_t len;
+
+        int err = pouch_gateway_uplink_reserve(slot->uplink, &buf, &len);
+        if (err)
+        {
+            /* Block pool exhausted by other sessions */
+            return true;
+        }
+
+        ssize_t ret = fs_read(&slot->file, buf, MIN(len, slot->size - slot->offset));
+        if (ret <= 0)
+        {
+            LOG_ERR("Failed to read spool file: %d", (int) ret);
+
+            /* Completing the upload would pass a truncated pouch off as
+               whole, so the cloud is left to drop it */
+            slot->read_failed = true;
+            pouch_gateway_uplink_abort(slot->uplink);
+            slot->uplink = NULL;
+            break;
+        }
+
+        slot->offset += ret;
+        pouch_gateway_uplink_commit(slot->uplink, ret, slot->offset >= slot->size);
+    }
+
+    return false;
+}
+
+static void drain_work_handler(struct k_work *work)
+{
+    bool retry = false;
+
+    /* Set by the init work, which runs first on this queue */
+    if (!spool_initialized)
+    {
+        atomic_clear(&draining);
+        return;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(drain_slots); i++)
+    {
+        struct spool_drain_slot *slot = &drain_slots[i];
+
+        if (!slot->active)
+        {
+            continue;
+        }
+
+        atomic_val_t result = atomic_get(&slot->result);
+        if (DRAIN_RESULT_PENDING != result)
+        {
+            slot->uplink = NULL;
+            drain_slot_finish(slot, result);
+        }
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(drain_slots); i++)
+    {
+        struct spool_drain_slot *slot = &drain_slots[i];
+
+        if (!slot->active && atomic_get(&draining) && drain_slot_start(slot))
+        {
+            /* Nothing left to drain, or the cloud went away */
+            atomic_clear(&draining);
+        }
+
+        if (slot->active)
+        {
+            retry |= drain_slot_pump(slot);
+        }
+    }
+
+    if (retry)
+    {
+        k_work_reschedule_for_queue(&spool_work_q, &drain_work, SPOOL_DRAIN_RETRY_DELAY);
+    }
+}
+
+void pouch_gateway_uplink_spool_drain(void)
+{
+    atomic_set(&draining, 1);
+
+    /* Work items run in order, so the spool is scanned before it is
+       drained if the file system was not mounted at boot */
+    k_work_submit_to_queue(&spool_work_q, &spool_init_work);
+    k_work_reschedule_for_queue(&spool_work_q, &drain_work, K_NO_WAIT);
+}
+
+void pouch_gateway_uplink_spool_stats_get(struct pouch_gateway_spool_stats *stats)
+{
+    k_mutex_lock(&spool_lock, K_FOREVER);
+
+    if (!spool_initialized)
+    {
+        k_work_submit_to_queue(&spool_work_q, &spool_init_work);
+    }
+
+    *stats = spool_stats;
+
+    k_mutex_unlock(&spool_lock);
+}
+
+void spool_work_submit(struct k_work *work)
+{
+    k_work_submit_to_queue(&spool_work_q, work);
+}
+
+static int spool_work_q_init(void)
+{
+    k_work_queue_start(&spool_work_q,
+                       spool_work_q_stack,
+                       K_THREAD_STACK_SIZEOF(spool_work_q_stack),
+                       K_LOWEST_APPLICATION_THREAD_PRIO,
+                       NULL);
+    k_thread_name_set(&spool_work_q.thread, "spool");
+
+    /* Scan the spool before the first node connects */
+    k_work_submit_to_queue(&spool_work_q, &spool_init_work);
+
+    return 0;
+}
+
+SYS_INIT(spool_work_q_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zephyr/fs/fs.h>
+#include <zephyr/kernel.h>
+
+#include <pouch_gateway/downlink.h>
+#include <pouch_gateway/uplink.h>
+
+struct spool_writer
+{
+    struct fs_file_t file;
+    uint32_t seq;
+    size_t len;
+    bool opened;
+};
+
+/* Only reserves a file, so that it can be called from the Bluetooth receive
+   path. The file itself is created by the first append or the commit. */
+int spool_writer_open(struct spool_writer *writer);
+
+/* Must be called from the spool work queue, like the functions below */
+int spool_writer_append(struct spool_writer *writer, const void *data, size_t len);
+int spool_writer_commit(struct spool_writer *writer);
+void spool_writer_discard(struct spool_writer *writer);
+
+/* Submit work to the spool work queue, which does all file system access
+   of the spool */
+void spool_work_submit(struct k_work *work);
@@ -4,9 +4,10 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
-#include <stdlib.h>
+#include <string.h>
 
-#include <zephyr/sys/atomic_types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
 
 #include <golioth/gateway.h>
 #include <golioth/stream.h>
@@ -14,18 +15,27 @@
 #include <pouch_gateway/downlink.h>
 #include <pouch_gateway/uplink.h>
 
+#include "spool.h"
+
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(uplink, CONFIG_POUCH_GATEWAY_LOG_LEVEL);
 
 enum pouch_flags
 {
     POUCH_UPLINK_CLOSED,
-    POUCH_UPLINK_SENDING,
+    POUCH_UPLINK_FAILED,
+    POUCH_UPLINK_FINISHED,
+    POUCH_UPLINK_CONGESTED,
+    POUCH_UPLINK_SPOOL,
+    POUCH_UPLINK_SPOOL_DONE,
+    POUCH_UPLINK_SUBMITTING,
+    POUCH_UPLINK_RESUBMIT,
 };
 
 struct pouch_block
 {
     sys_snode_t node;
+    struct pouch_gateway_uplink *uplink;
     size_t len;
     uint8_t data[CONFIG_GOLIOTH_BLOCKWISE_UPLOAD_MAX_BLOCK_SIZE];
 };
@@ -33,22 +43,292 @@ struct pouch_block
 struct pouch_gateway_uplink
 {
     struct gateway_uplink *session;
+    struct pouch_gateway_downlink_context *downlink;
+    struct spool_writer spool;
+    sys_snode_t spool_node;
+    bool spool_pending;
     uint32_t block_idx;
     atomic_t flags[1];
+    atomic_t refs;
+    struct k_spinlock lock;
     struct pouch_block *wblock;
-    struct pouch_block *rblock;
     sys_slist_t queue;
+    size_t queued;
+    size_t inflight;
+    size_t blocks_used;
+    size_t blocks_claimed;
+    sys_snode_t quota_node;
+    bool quota_waiting;
+    size_t total_len;
+    int64_t start_time;
     pouch_gateway_uplink_end_cb end_cb;
+    pouch_gateway_uplink_writable_cb writable_cb;
     void *end_cb_arg;
 };
 
-static struct golioth_client *client;
+/* Set by the main thread, read by the Bluetooth threads opening uplinks */
+static atomic_ptr_t client;
+
+K_MEM_SLAB_DEFINE_STATIC(uplink_block_slab,
+                         sizeof(struct pouch_block),
+                         CONFIG_POUCH_GATEWAY_UPLINK_NUM_BLOCKS,
+                         4);
+
+/* The quota admits one uplink for every CONFIG_POUCH_GATEWAY_UPLINK_MIN_BLOCKS
+   blocks in the pool */
+#define UPLINK_MAX_OPEN \
+    (CONFIG_POUCH_GATEWAY_UPLINK_NUM_BLOCKS / CONFIG_POUCH_GATEWAY_UPLINK_MIN_BLOCKS)
+
+K_MEM_SLAB_DEFINE_STATIC(uplink_slab, sizeof(struct pouch_gateway_uplink), UPLINK_MAX_OPEN, 8);
+
+BUILD_ASSERT(CONFIG_POUCH_GATEWAY_UPLINK_HIGH_WATERMARK >= CONFIG_POUCH_GATEWAY_UPLINK_WINDOW,
+             "Uplink high watermark below the window would limit the blocks in flight");
+
+static atomic_t blocks_peak;
+static atomic_t alloc_failures;
+
+#ifdef CONFIG_POUCH_GATEWAY_SPOOL
+
+/* Spooled uplinks are processed on the spool work queue, so that the
+   thread committing data, usually the Bluetooth receive path, does not
+   wait for the file system */
+static struct k_spinlock spool_lock;
+static sys_slist_t spool_pending;
+
+static void spool_work_handler(struct k_work *work);
+static K_WORK_DEFINE(spool_work, spool_work_handler);
+
+#endif /* CONFIG_POUCH_GATEWAY_SPOOL */
+
+/* Every open uplink is guaranteed CONFIG_POUCH_GATEWAY_UPLINK_MIN_BLOCKS
+   blocks, so a node can always make progress however busy the others are.
+   Whatever is left in the pool is shared by all uplinks. */
+static struct k_spinlock quota_lock;
+static size_t open_uplinks;
+static size_t shared_used;
+static sys_slist_t quota_waiters;
+
+/* Must be called with quota_lock held */
+static size_t shared_capacity(void)
+{
+    return CONFIG_POUCH_GATEWAY_UPLINK_NUM_BLOCKS
+        - open_uplinks * CONFIG_POUCH_GATEWAY_UPLINK_MIN_BLOCKS;
+}
+
+/* Reserve the guaranteed blocks of a new uplink. Fails if the blocks are
+   taken, either reserved by other uplinks or borrowed from the shared
+   part of the pool. */
+static bool quota_open(void)
+{
+    bool opened = false;
+
+    K_SPINLOCK(&quota_lock)
+    {
+        if (shared_used + CONFIG_POUCH_GATEWAY_UPLINK_MIN_BLOCKS <= shared_capacity())
+        {
+            open_uplinks++;
+            opened = true;
+        }
+    }
+
+    return opened;
+}
+
+/* Take over the writable callback of an uplink waiting for shared blocks.
+   Must be called with quota_lock held. */
+static void quota_wake(pouch_gateway_uplink_writable_cb *cb, void **arg)
+{
+    sys_snode_t *n = sys_slist_get(&quota_waiters);
+    if (n == NULL)
+    {
+        return;
+    }
+
+    struct pouch_gateway_uplink *waiter = CONTAINER_OF(n, struct pouch_gateway_uplink, quota_node);
+
+    waiter->quota_waiting = false;
+    *cb = waiter->writable_cb;
+    *arg = waiter->end_cb_arg;
+}
+
+static void quota_close(void)
+{
+    pouch_gateway_uplink_writable_cb cb = NULL;
+    void *arg = NULL;
+
+    K_SPINLOCK(&quota_lock)
+    {
+        open_uplinks--;
+        quota_wake(&cb, &arg);
+    }
+
+    if (cb != NULL)
+    {
+        cb(arg);
+    }
+}
+
+/* Must be called with quota_lock held */
+static bool quota_take_locked(struct pouch_gateway_uplink *uplink)
+{
+    if (uplink->blocks_used < CONFIG_POUCH_GATEWAY_UPLINK_MIN_BLOCKS)
+    {
+        uplink->blocks_used++;
+        return true;
+    }
+
+    if (shared_used < shared_capacity())
+    {
+        shared_used++;
+        uplink->blocks_used++;
+        return true;
+    }
+
+    return false;
+}
+
+static bool quota_take(struct pouch_gateway_uplink *uplink)
+{
+    bool taken = false;
+
+    K_SPINLOCK(&quota_lock)
+    {
+        taken = quota_take_locked(uplink);
+    }
+
+    return taken;
+}
+
+static void quota_give(struct pouch_gateway_uplink *uplink)
+{
+    pouch_gateway_uplink_writable_cb cb = NULL;
+    void *arg = NULL;
+
+    K_SPINLOCK(&quota_lock)
+    {
+        if (uplink->blocks_used > CONFIG_POUCH_GATEWAY_UPLINK_MIN_BLOCKS)
+        {
+            shared_used--;
+        }
+        uplink->blocks_used--;
+
+        /* A block returned within the guaranteed ones is only of use to
+           the uplink itself */
+        if (uplink->quota_waiting)
+        {
+            sys_slist_find_and_remove(&quota_waiters, &uplink->quota_node);
+            sys_slist_prepend(&quota_waiters, &uplink->quota_node);
+            quota_wake(&cb, &arg);
+        }
+        else if (uplink->blocks_used >= CONFIG_POUCH_GATEWAY_UPLINK_MIN_BLOCKS)
+        {
+            quota_wake(&cb, &arg);
+        }
+    }
+
+    if (cb != NULL)
+    {
+        cb(arg);
+    }
+}
+
+/* Claim the blocks needed to take len more bytes, so that data the
+   transport accepts from the node always fits. If the pool is out of
+   blocks, the uplink waits for another uplink to return some. */
+static bool quota_claim(struct pouch_gateway_uplink *uplink, size_t len)
+{
+    size_t room = uplink->wblock != NULL ? sizeof(uplink->wblock->data) - uplink->wblock->len : 0;
+    size_t needed = 0;
+    bool claimed = true;
+
+    if (len > room)
+    {
+        needed = DIV_ROUND_UP(len - room, CONFIG_GOLIOTH_BLOCKWISE_UPLOAD_MAX_BLOCK_SIZE);
+    }
+
+    K_SPINLOCK(&quota_lock)
+    {
+        while (uplink->blocks_claimed < needed)
+        {
+            if (!quota_take_locked(uplink))
+            {
+                if (!uplink->quota_waiting)
+                {
+                    sys_slist_append(&quota_waiters, &uplink->quota_node);
+                    uplink->quota_waiting = true;
+                }
+
+                claimed = false;
+                break;
+            }
+
+            uplink->blocks_claimed++;
+        }
+    }
+
+    return claimed;
+}
 
 static void process_uplink(struct pouch_gateway_uplink *uplink);
 
+/* The uplink holds a reference of its own until it ends. Threads that may
+   see it end while they still use it hold another one, so that it is only
+   freed once they are done. */
+static void uplink_get(struct pouch_gateway_uplink *uplink)
+{
+    atomic_inc(&uplink->refs);
+}
+
+static void uplink_put(struct pouch_gateway_uplink *uplink)
+{
+    if (atomic_dec(&uplink->refs) == 1)
+    {
+        k_mem_slab_free(&uplink_slab, uplink);
+    }
+}
+
+static void block_free(struct pouch_block *block)
+{
+    quota_give(block->uplink);
+    k_mem_slab_free(&uplink_block_slab, block);
+}
+
+static bool is_spooled(struct pouch_gateway_uplink *uplink)
+{
+    return IS_ENABLED(CONFIG_POUCH_GATEWAY_SPOOL)
+        && atomic_test_bit(uplink->flags, POUCH_UPLINK_SPOOL);
+}
+
 static void cleanup_uplink(struct pouch_gateway_uplink *uplink)
 {
-    if (IS_ENABLED(CONFIG_POUCH_GATEWAY_CLOUD))
+    K_SPINLOCK(&quota_lock)
+    {
+        if (uplink->quota_waiting)
+        {
+            sys_slist_find_and_remove(&quota_waiters, &uplink->quota_node);
+            uplink->quota_waiting = false;
+        }
+    }
+
+    if (is_spooled(uplink))
+    {
+#ifdef CONFIG_POUCH_GATEWAY_SPOOL
+        K_SPINLOCK(&spool_lock)
+        {
+            if (uplink->spool_pending)
+            {
+                sys_slist_find_and_remove(&spool_pending, &uplink->spool_node);
+                uplink->spool_pending = false;
+            }
+        }
+#endif
+
+        if (!atomic_test_bit(uplink->flags, POUCH_UPLINK_SPOOL_DONE))
+        {
+            spool_writer_discard(&uplink->spool);
+        }
+    }
+    else if (IS_ENABLED(CONFIG_POUCH_GATEWAY_CLOUD))
     {
         golioth_gateway_uplink_finish(uplink->session);
     }
@@ -56,12 +336,51 @@ static void cleanup_uplink(struct pouch_gateway_uplink *uplink)
     sys_snode_t *n;
     while ((n = sys_slist_get(&uplink->queue)) != NULL)
     {
-        free(CONTAINER_OF(n, struct pouch_block, node));
+        block_free(CONTAINER_OF(n, struct pouch_block, node));
+    }
+
+    if (uplink->wblock != NULL)
+    {
+        block_free(uplink->wblock);
+    }
+
+    for (; uplink->blocks_claimed > 0; uplink->blocks_claimed--)
+    {
+        quota_give(uplink);
+    }
+
+    quota_close();
+    uplink_put(uplink);
+}
+
+static void fail_uplink(struct pouch_gateway_uplink *uplink, enum pouch_gateway_uplink_result res)
+{
+    if (!atomic_test_and_set_bit(uplink->flags, POUCH_UPLINK_FAILED))
+    {
+        uplink->end_cb(uplink->end_cb_arg, res);
     }
 
-    free(uplink->wblock);
-    free(uplink->rblock);
-    free(uplink);
+    process_uplink(uplink);
+}
+
+static void block_completed(struct pouch_gateway_uplink *uplink)
+{
+    bool writable = false;
+
+    K_SPINLOCK(&uplink->lock)
+    {
+        uplink->inflight--;
+
+        if (uplink->queued + uplink->inflight < CONFIG_POUCH_GATEWAY_UPLINK_HIGH_WATERMARK)
+        {
+            writable = atomic_test_and_clear_bit(uplink->flags, POUCH_UPLINK_CONGESTED);
+        }
+    }
+
+    if (writable && uplink->writable_cb != NULL)
+    {
+        uplink->writable_cb(uplink->end_cb_arg);
+    }
 }
 
 static void block_upload_callback(struct golioth_client *client,
@@ -71,102 +390,303 @@ static void block_upload_callback(struct golioth_client *client,
                                   size_t block_size,
                                   void *arg)
 {
-    struct pouch_gateway_uplink *uplink = arg;
+    struct pouch_block *block = arg;
+    struct pouch_gateway_uplink *uplink = block->uplink;
 
-    if (!atomic_test_and_clear_bit(uplink->flags, POUCH_UPLINK_SENDING))
-    {
-        LOG_ERR("Not sending");
-        return;
-    }
+    /* Once the block no longer counts as in flight, another thread may
+       end the uplink */
+    uplink_get(uplink);
 
-    free(uplink->rblock);
-    uplink->rblock = NULL;
+    block_free(block);
 
     if (status != GOLIOTH_OK)
     {
         LOG_ERR("Failed to deliver block: %d", status);
-        uplink->end_cb(uplink->end_cb_arg, POUCH_GATEWAY_UPLINK_ERROR_CLOUD);
-        cleanup_uplink(uplink);
-        return;
+        K_SPINLOCK(&uplink->lock)
+        {
+            uplink->inflight--;
+        }
+        fail_uplink(uplink, POUCH_GATEWAY_UPLINK_ERROR_CLOUD);
+    }
+    else
+    {
+        block_completed(uplink);
+        process_uplink(uplink);
     }
 
-    process_uplink(uplink);
+    uplink_put(uplink);
 }
 
-static void process_uplink(struct pouch_gateway_uplink *uplink)
+/* Take the next block to upload, if the window allows it. The final block
+   is held back until all preceding blocks have been acknowledged. */
+static struct pouch_block *next_block(struct pouch_gateway_uplink *uplink,
+                                      uint32_t *block_idx,
+                                      bool *is_last,
+                                      bool *finished)
 {
-    enum golioth_status status;
-    if (atomic_test_and_set_bit(uplink->flags, POUCH_UPLINK_SENDING))
+    struct pouch_block *block = NULL;
+
+    *finished = false;
+
+    K_SPINLOCK(&uplink->lock)
     {
-        LOG_DBG("Already processing queue");
-        return;
+        bool closed = atomic_test_bit(uplink->flags, POUCH_UPLINK_CLOSED);
+        sys_snode_t *n = sys_slist_peek_head(&uplink->queue);
+        if (n == NULL)
+        {
+            if (closed && uplink->inflight == 0
+                && !atomic_test_and_set_bit(uplink->flags, POUCH_UPLINK_FINISHED))
+            {
+                *finished = true;
+            }
+
+            K_SPINLOCK_BREAK;
+        }
+
+        if (uplink->inflight >= CONFIG_POUCH_GATEWAY_UPLINK_WINDOW)
+        {
+            K_SPINLOCK_BREAK;
+        }
+
+        *is_last = closed && n == sys_slist_peek_tail(&uplink->queue);
+        if (*is_last && uplink->inflight > 0)
+        {
+            K_SPINLOCK_BREAK;
+        }
+
+        sys_slist_get(&uplink->queue);
+        uplink->queued--;
+        block = CONTAINER_OF(n, struct pouch_block, node);
+        if (block->len > 0)
+        {
+            *block_idx = uplink->block_idx++;
+            uplink->inflight++;
+        }
     }
 
-    bool closed = atomic_test_bit(uplink->flags, POUCH_UPLINK_CLOSED);
+    return block;
+}
 
-    sys_snode_t *n = sys_slist_get(&uplink->queue);
-    if (n == NULL)
+/* Submit the queued blocks. Returns true if the uplink ended and was freed. */
+static bool submit_blocks(struct pouch_gateway_uplink *uplink)
+{
+    enum golioth_status status;
+    struct pouch_block *block;
+    uint32_t block_idx = 0;
+    bool is_last = false;
+    bool finished;
+
+    if (atomic_test_bit(uplink->flags, POUCH_UPLINK_FAILED))
     {
-        LOG_DBG("No blocks to process");
-        if (closed)
+        bool cleanup = false;
+
+        /* Blocks still in flight reference the uplink, so the last one to
+           complete does the cleanup */
+        K_SPINLOCK(&uplink->lock)
+        {
+            cleanup = uplink->inflight == 0
+                && !atomic_test_and_set_bit(uplink->flags, POUCH_UPLINK_FINISHED);
+        }
+
+        if (cleanup)
         {
-            uplink->end_cb(uplink->end_cb_arg, POUCH_GATEWAY_UPLINK_SUCCESS);
             cleanup_uplink(uplink);
-            return;
         }
 
-        atomic_clear_bit(uplink->flags, POUCH_UPLINK_SENDING);
-        return;
+        return cleanup;
     }
 
-    uplink->rblock = CONTAINER_OF(n, struct pouch_block, node);
+    while ((block = next_block(uplink, &block_idx, &is_last, &finished)) != NULL)
+    {
+        if (block->len == 0)
+        {
+            LOG_WRN("Skipping zero length block");
+            block_free(block);
+            continue;
+        }
+
+        LOG_DBG("Processing block %u of size %zu", block_idx, block->len);
 
-    LOG_DBG("Processing block %zu of size %zu", uplink->block_idx, uplink->rblock->len);
+        if (is_spooled(uplink))
+        {
+            int err = spool_writer_append(&uplink->spool, block->data, block->len);
+            block_free(block);
+            block_completed(uplink);
+            if (err)
+            {
+                fail_uplink(uplink, POUCH_GATEWAY_UPLINK_ERROR_LOCAL);
+                return false;
+            }
+            continue;
+        }
 
-    if (!IS_ENABLED(CONFIG_POUCH_GATEWAY_CLOUD))
-    {
-        free(uplink->rblock);
-        uplink->rblock = NULL;
-        atomic_clear_bit(uplink->flags, POUCH_UPLINK_SENDING);
+        if (!IS_ENABLED(CONFIG_POUCH_GATEWAY_CLOUD))
+        {
+            block_free(block);
+            block_completed(uplink);
+            continue;
+        }
 
-        return;
+        status = golioth_gateway_uplink_block(uplink->session,
+                                              block_idx,
+                                              block->data,
+                                              block->len,
+                                              is_last,
+                                              block_upload_callback,
+                                              block);
+        if (status != GOLIOTH_OK)
+        {
+            LOG_ERR("Failed to deliver block: %d", status);
+            block_free(block);
+            K_SPINLOCK(&uplink->lock)
+            {
+                uplink->inflight--;
+            }
+            fail_uplink(uplink, POUCH_GATEWAY_UPLINK_ERROR_LOCAL);
+            return false;
+        }
     }
 
-    if (uplink->rblock->len == 0)
+    if (finished && is_spooled(uplink))
     {
-        LOG_WRN("Skipping zero length block");
+        atomic_set_bit(uplink->flags, POUCH_UPLINK_SPOOL_DONE);
 
-        free(uplink->rblock);
-        uplink->rblock = NULL;
-        atomic_clear_bit(uplink->flags, POUCH_UPLINK_SENDING);
+        int err = spool_writer_commit(&uplink->spool);
 
-        return;
+        uplink->end_cb(uplink->end_cb_arg,
+                       err ? POUCH_GATEWAY_UPLINK_ERROR_LOCAL : POUCH_GATEWAY_UPLINK_SUCCESS);
+
+        /* There is no cloud response to deliver to the node */
+        if (uplink->downlink != NULL)
+        {
+            pouch_gateway_downlink_finish(uplink->downlink);
+        }
+
+        cleanup_uplink(uplink);
+        return true;
     }
 
-    status = golioth_gateway_uplink_block(uplink->session,
-                                          uplink->block_idx++,
-                                          uplink->rblock->data,
-                                          uplink->rblock->len,
-                                          sys_slist_is_empty(&uplink->queue) && closed,
-                                          block_upload_callback,
-                                          uplink);
-    if (status != GOLIOTH_OK)
+    if (finished)
     {
-        LOG_ERR("Failed to deliver block: %d", status);
-        uplink->end_cb(uplink->end_cb_arg, POUCH_GATEWAY_UPLINK_ERROR_LOCAL);
+        LOG_DBG("Uplink of %zu bytes completed in %lld ms",
+                uplink->total_len,
+                k_uptime_get() - uplink->start_time);
+
+        uplink->end_cb(uplink->end_cb_arg, POUCH_GATEWAY_UPLINK_SUCCESS);
         cleanup_uplink(uplink);
+        return true;
+    }
+
+    return false;
+}
+
+static void submit_pending_blocks(struct pouch_gateway_uplink *uplink)
+{
+    /* Block indices are assigned in queue order, so only one thread at a
+       time may submit blocks for them to reach the cloud in order. A thread
+       finding another one submitting leaves the work to that thread. */
+    atomic_set_bit(uplink->flags, POUCH_UPLINK_RESUBMIT);
+
+    while (atomic_test_bit(uplink->flags, POUCH_UPLINK_RESUBMIT)
+           && !atomic_test_and_set_bit(uplink->flags, POUCH_UPLINK_SUBMITTING))
+    {
+        atomic_clear_bit(uplink->flags, POUCH_UPLINK_RESUBMIT);
+
+        if (submit_blocks(uplink))
+        {
+            return;
+        }
+
+        atomic_clear_bit(uplink->flags, POUCH_UPLINK_SUBMITTING);
+    }
+}
+
+#ifdef CONFIG_POUCH_GATEWAY_SPOOL
+
+static void spool_work_handler(struct k_work *work)
+{
+    while (true)
+    {
+        struct pouch_gateway_uplink *uplink = NULL;
+
+        K_SPINLOCK(&spool_lock)
+        {
+            sys_snode_t *n = sys_slist_get(&spool_pending);
+            if (n != NULL)
+            {
+                uplink = CONTAINER_OF(n, struct pouch_gateway_uplink, spool_node);
+                uplink->spool_pending = false;
+                uplink_get(uplink);
+            }
+        }
+
+        if (uplink == NULL)
+        {
+            break;
+        }
+
+        submit_pending_blocks(uplink);
+        uplink_put(uplink);
     }
 }
 
+#endif /* CONFIG_POUCH_GATEWAY_SPOOL */
+
+static void process_uplink(struct pouch_gateway_uplink *uplink)
+{
+#ifdef CONFIG_POUCH_GATEWAY_SPOOL
+    if (is_spooled(uplink))
+    {
+        K_SPINLOCK(&spool_lock)
+        {
+            if (!uplink->spool_pending)
+            {
+                sys_slist_append(&spool_pending, &uplink->spool_node);
+                uplink->spool_pending = true;
+            }
+        }
+
+        spool_work_submit(&spool_work);
+        return;
+    }
+#endif
+
+    submit_pending_blocks(uplink);
+}
+
 static struct pouch_block *block_alloc(struct pouch_gateway_uplink *uplink)
 {
-    struct pouch_block *block = malloc(sizeof(struct pouch_block));
-    if (block == NULL)
+    struct pouch_block *block = NULL;
+
+    if (uplink->blocks_claimed > 0)
+    {
+        uplink->blocks_claimed--;
+    }
+    else if (!quota_take(uplink))
+    {
+        LOG_ERR("Uplink out of blocks");
+        atomic_inc(&alloc_failures);
+        return NULL;
+    }
+
+    /* The quota never hands out more blocks than the slab holds */
+    int err = k_mem_slab_alloc(&uplink_block_slab, (void **) &block, K_NO_WAIT);
+    if (err)
     {
         LOG_ERR("Failed to alloc block");
+        quota_give(uplink);
+        atomic_inc(&alloc_failures);
         return NULL;
     }
 
+    atomic_val_t used = k_mem_slab_num_used_get(&uplink_block_slab);
+    atomic_val_t peak = atomic_get(&blocks_peak);
+    while (used > peak && !atomic_cas(&blocks_peak, peak, used))
+    {
+        peak = atomic_get(&blocks_peak);
+    }
+
+    block->uplink = uplink;
     block->len = 0;
 
     return block;
@@ -175,10 +695,70 @@ static struct pouch_block *block_alloc(struct pouch_gateway_uplink *uplink)
 static void submit_block(struct pouch_gateway_uplink *uplink)
 {
     LOG_DBG("Submitting block of size %zu", uplink->wblock->len);
-    sys_slist_append(&uplink->queue, &uplink->wblock->node);
+    K_SPINLOCK(&uplink->lock)
+    {
+        sys_slist_append(&uplink->queue, &uplink->wblock->node);
+        uplink->queued++;
+    }
     uplink->wblock = NULL;
 }
 
+int pouch_gateway_uplink_reserve(struct pouch_gateway_uplink *uplink, uint8_t **buf, size_t *len)
+{
+    if (uplink->wblock != NULL && uplink->wblock->len == sizeof(uplink->wblock->data))
+    {
+        submit_block(uplink);
+    }
+
+    if (uplink->wblock == NULL)
+    {
+        uplink->wblock = block_alloc(uplink);
+        if (uplink->wblock == NULL)
+        {
+            LOG_ERR("Failed to alloc new block");
+            return -ENOMEM;
+        }
+    }
+
+    *buf = &uplink->wblock->data[uplink->wblock->len];
+    *len = sizeof(uplink->wblock->data) - uplink->wblock->len;
+
+    return 0;
+}
+
+static int commit_block(struct pouch_gateway_uplink *uplink, size_t len, bool is_last)
+{
+    if (uplink->wblock == NULL || len > sizeof(uplink->wblock->data) - uplink->wblock->len)
+    {
+        return -EINVAL;
+    }
+
+    uplink->wblock->len += len;
+    uplink->total_len += len;
+
+    /* Submit full blocks right away, except for the final one which is
+       submitted by pouch_gateway_uplink_close() */
+    if (uplink->wblock->len == sizeof(uplink->wblock->data) && !is_last)
+    {
+        submit_block(uplink);
+    }
+
+    return 0;
+}
+
+int pouch_gateway_uplink_commit(struct pouch_gateway_uplink *uplink, size_t len, bool is_last)
+{
+    int err = commit_block(uplink, len, is_last);
+    if (err)
+    {
+        return err;
+    }
+
+    process_uplink(uplink);
+
+    return 0;
+}
+
 int pouch_gateway_uplink_write(struct pouch_gateway_uplink *uplink,
                                const uint8_t *payload,
                                size_t len,
@@ -186,28 +766,23 @@ int pouch_gateway_uplink_write(struct pouch_gateway_uplink *uplink,
 {
     while (len)
     {
-        if (uplink->wblock != NULL && uplink->wblock->len == sizeof(uplink->wblock->data))
-        {
-            submit_block(uplink);
-        }
+        uint8_t *buf;
+        size_t buf_len;
 
-        if (uplink->wblock == NULL)
+        int err = pouch_gateway_uplink_reserve(uplink, &buf, &buf_len);
+        if (err)
         {
-            uplink->wblock = block_alloc(uplink);
-            if (uplink->wblock == NULL)
-            {
-                LOG_ERR("Failed to alloc new block");
-                return -ENOMEM;
-            }
+            return err;
         }
 
-        size_t bytes_to_copy = MIN(len, sizeof(uplink->wblock->data) - uplink->wblock->len);
+        size_t bytes_to_copy = MIN(len, buf_len);
 
-        memcpy(&uplink->wblock->data[uplink->wblock->len], payload, bytes_to_copy);
-        uplink->wblock->len += bytes_to_copy;
+        memcpy(buf, payload, bytes_to_copy);
 
         len -= bytes_to_copy;
         payload += bytes_to_copy;
+
+        commit_block(uplink, bytes_to_copy, is_last && len == 0);
     }
 
     process_uplink(uplink);
@@ -215,62 +790,242 @@ int pouch_gateway_uplink_write(struct pouch_gateway_uplink *uplink,
     return 0;
 }
 
+bool pouch_gateway_uplink_is_congested(struct pouch_gateway_uplink *uplink, size_t len)
+{
+    bool congested = false;
+
+    K_SPINLOCK(&uplink->lock)
+    {
+        if (uplink->queued + uplink->inflight >= CONFIG_POUCH_GATEWAY_UPLINK_HIGH_WATERMARK)
+        {
+            atomic_set_bit(uplink->flags, POUCH_UPLINK_CONGESTED);
+            congested = true;
+        }
+    }
+
+    return congested || !quota_claim(uplink, len);
+}
+
+void pouch_gateway_uplink_stats_get(struct pouch_gateway_uplink_stats *stats)
+{
+    stats->blocks_total = CONFIG_POUCH_GATEWAY_UPLINK_NUM_BLOCKS;
+    stats->blocks_used = k_mem_slab_num_used_get(&uplink_block_slab);
+    stats->blocks_peak = atomic_get(&blocks_peak);
+    stats->alloc_failures = atomic_get(&alloc_failures);
+}
+
 void pouch_gateway_uplink_module_init(struct golioth_client *c)
 {
-    client = c;
+    atomic_ptr_set(&client, c);
 }
 
-struct pouch_gateway_uplink *pouch_gateway_uplink_open(
-    struct pouch_gateway_downlink_context *downlink,
-    pouch_gateway_uplink_end_cb end_cb,
-    void *end_cb_arg)
+/* The cloud response to an uplink without a downlink has nowhere to go */
+static enum golioth_status discard_block_cb(const uint8_t *data,
+                                            size_t len,
+                                            bool is_last,
+                                            void *arg)
 {
-    struct pouch_gateway_uplink *uplink = malloc(sizeof(struct pouch_gateway_uplink));
-    if (uplink == NULL)
+    return GOLIOTH_OK;
+}
+
+static void discard_end_cb(enum golioth_status status,
+                           const struct golioth_coap_rsp_code *coap_rsp_code,
+                           void *arg)
+{
+    if (GOLIOTH_OK != status)
+    {
+        LOG_WRN("Discarded downlink ended with error %d", status);
+    }
+}
+
+static struct pouch_gateway_uplink *uplink_open(struct pouch_gateway_downlink_context *downlink,
+                                               pouch_gateway_uplink_end_cb end_cb,
+                                               pouch_gateway_uplink_writable_cb writable_cb,
+                                               void *end_cb_arg,
+                                               bool allow_spool)
+{
+    struct golioth_client *c = atomic_ptr_get(&client);
+    bool spool = false;
+
+    allow_spool = allow_spool && IS_ENABLED(CONFIG_POUCH_GATEWAY_SPOOL);
+
+    if (IS_ENABLED(CONFIG_POUCH_GATEWAY_CLOUD) && (c == NULL || !golioth_client_is_connected(c)))
+    {
+        if (!allow_spool)
+        {
+            LOG_WRN("Not connected to cloud");
+            return NULL;
+        }
+
+        spool = true;
+    }
+
+    if (!quota_open())
+    {
+        LOG_WRN("Uplink buffer full");
+        atomic_inc(&alloc_failures);
+        return NULL;
+    }
+
+    /* Only fails while a closed uplink waits for its last block callback
+       to return */
+    struct pouch_gateway_uplink *uplink;
+    if (k_mem_slab_alloc(&uplink_slab, (void **) &uplink, K_NO_WAIT))
     {
+        LOG_WRN("No free uplink context");
+        quota_close();
+        atomic_inc(&alloc_failures);
         return NULL;
     }
 
+    uplink->blocks_used = 0;
+    uplink->blocks_claimed = 0;
+    uplink->quota_waiting = false;
     uplink->wblock = block_alloc(uplink);
     if (uplink->wblock == NULL)
     {
-        free(uplink);
+        quota_close();
+        k_mem_slab_free(&uplink_slab, uplink);
         return NULL;
     }
 
-    if (IS_ENABLED(CONFIG_POUCH_GATEWAY_CLOUD))
+    atomic_set(uplink->flags, 0);
+    atomic_set(&uplink->refs, 1);
+    uplink->session = NULL;
+
+    if (IS_ENABLED(CONFIG_POUCH_GATEWAY_CLOUD) && !spool)
     {
-        uplink->session = golioth_gateway_uplink_start(client,
-                                                       pouch_gateway_downlink_block_cb,
-                                                       pouch_gateway_downlink_end_cb,
-                                                       downlink);
+        if (downlink != NULL)
+        {
+            uplink->session = golioth_gateway_uplink_start(c,
+                                                           pouch_gateway_downlink_block_cb,
+                                                           pouch_gateway_downlink_end_cb,
+                                                           downlink);
+        }
+        else
+        {
+            uplink->session =
+                golioth_gateway_uplink_start(c, discard_block_cb, discard_end_cb, NULL);
+        }
         if (uplink->session == NULL)
         {
             LOG_ERR("Failed to start blockwise upload");
-            free(uplink->wblock);
-            free(uplink);
-            return NULL;
+            spool = allow_spool;
         }
     }
 
-    uplink->rblock = NULL;
+    if (spool && spool_writer_open(&uplink->spool))
+    {
+        spool = false;
+        uplink->session = NULL;
+    }
+
+    if (spool)
+    {
+        uplink->spool_pending = false;
+        atomic_set_bit(uplink->flags, POUCH_UPLINK_SPOOL);
+    }
+    else if (IS_ENABLED(CONFIG_POUCH_GATEWAY_CLOUD) && uplink->session == NULL)
+    {
+        block_free(uplink->wblock);
+        quota_close();
+        k_mem_slab_free(&uplink_slab, uplink);
+        return NULL;
+    }
+
+    uplink->downlink = downlink;
     uplink->block_idx = 0;
-    atomic_set(uplink->flags, 0);
+    uplink->queued = 0;
+    uplink->inflight = 0;
+    uplink->total_len = 0;
+    uplink->start_time = k_uptime_get();
+    memset(&uplink->lock, 0, sizeof(uplink->lock));
     sys_slist_init(&uplink->queue);
     uplink->end_cb = end_cb;
+    uplink->writable_cb = writable_cb;
     uplink->end_cb_arg = end_cb_arg;
 
     return uplink;
 }
 
+struct pouch_gateway_uplink *pouch_gateway_uplink_open(
+    struct pouch_gateway_downlink_context *downlink,
+    pouch_gateway_uplink_end_cb end_cb,
+    pouch_gateway_uplink_writable_cb writable_cb,
+    void *end_cb_arg)
+{
+    return uplink_open(downlink, end_cb, writable_cb, end_cb_arg, true);
+}
+
+struct pouch_gateway_uplink *pouch_gateway_uplink_open_cloud(
+    struct pouch_gateway_downlink_context *downlink,
+    pouch_gateway_uplink_end_cb end_cb,
+    pouch_gateway_uplink_writable_cb writable_cb,
+    void *end_cb_arg)
+{
+    return uplink_open(downlink, end_cb, writable_cb, end_cb_arg, false);
+}
+
+int pouch_gateway_uplink_discard(struct pouch_gateway_uplink *uplink)
+{
+    bool idle = false;
+
+    K_SPINLOCK(&uplink->lock)
+    {
+        idle = uplink->block_idx == 0 && uplink->queued == 0 && uplink->inflight == 0
+            && (uplink->wblock == NULL || uplink->wblock->len == 0);
+        if (idle)
+        {
+            atomic_set_bit(uplink->flags, POUCH_UPLINK_CLOSED);
+            atomic_set_bit(uplink->flags, POUCH_UPLINK_FINISHED);
+        }
+    }
+
+    if (!idle)
+    {
+        return -EBUSY;
+    }
+
+    LOG_DBG("Discarding unused uplink");
+
+    /* No block was sent, so ending the session is local to the client */
+    cleanup_uplink(uplink);
+
+    return 0;
+}
+
 void pouch_gateway_uplink_close(struct pouch_gateway_uplink *uplink)
 {
-    bool closed = atomic_test_and_set_bit(uplink->flags, POUCH_UPLINK_CLOSED);
+    /* A closed uplink may end on another thread as soon as its last block
+       is acknowledged */
+    uplink_get(uplink);
 
-    if (!closed && uplink->wblock != NULL)
+    /* The final block is queued along with closing, so that no thread sees
+       the uplink closed while its final block is still missing */
+    K_SPINLOCK(&uplink->lock)
     {
-        submit_block(uplink);
+        bool closed = atomic_test_and_set_bit(uplink->flags, POUCH_UPLINK_CLOSED);
+
+        if (!closed && uplink->wblock != NULL)
+        {
+            LOG_DBG("Submitting final block of size %zu", uplink->wblock->len);
+            sys_slist_append(&uplink->queue, &uplink->wblock->node);
+            uplink->queued++;
+            uplink->wblock = NULL;
+        }
     }
 
     process_uplink(uplink);
+    uplink_put(uplink);
+}
+
+void pouch_gateway_uplink_abort(struct pouch_gateway_uplink *uplink)
+{
+    uplink_get(uplink);
+
+    /* Nothing is queued after this, and the final block is never sent */
+    atomic_set_bit(uplink->flags, POUCH_UPLINK_CLOSED);
+    fail_uplink(uplink, POUCH_GATEWAY_UPLINK_ERROR_LOCAL);
+
+    uplink_put(uplink);
 }
@@ -339,6 +339,8 @@ int main(void)
         gpio_add_callback(button.port, &button_cb_data);
     }
 
+    pouch_gateway_cert_module_init();
+
     connect_to_cloud();
 
     pouch_gateway_cert_module_on_connected(client);
@@ -0,0 +1,20 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Get the host's monotonic time.
+ *
+ * Time on native_sim only advances when the simulated CPU sleeps, so code
+ * run between two reads of the kernel clock appears to take no time at all.
+ * Benchmarks of processing cost read the host clock instead.
+ *
+ * @return Host time in nanoseconds.
+ */
+uint64_t bench_host_time_ns(void);
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Processing cost of advertising reports in the scan path. Each node
+   sends an advertisement and a scan response, as with active scanning.
+   Reports are repeated unchanged, which is what the gateway mostly
+   hears, or carry a counter that changes with every report, so that
+   each one has to be parsed. */
+
+#include <string.h>
+
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/ztest.h>
+
+#include <pouch/transport/gatt/common/types.h>
+#include <pouch/transport/gatt/common/uuids.h>
+
+#include <pouch_gateway/bt/scan.h>
+
+#include "host_clock.h"
+
+#define NODES 8
+#define REPORTS 200000
+
+/* Reports are alternately advertisements and scan responses */
+#define REPORT_TYPES 2
+
+static struct bt_le_scan_cb *scan_cb;
+
+/* Registered by pouch_gateway_scan_start() */
+int __wrap_bt_le_scan_cb_register(struct bt_le_scan_cb *cb)
+{
+    scan_cb = cb;
+
+    return 0;
+}
+
+/* There is no controller, reports are fed by the benchmark */
+int __wrap_bt_le_scan_start(const struct bt_le_scan_param *param, bt_le_scan_cb_t cb)
+{
+    return 0;
+}
+
+static const uint8_t report_types[REPORT_TYPES] = {
+    BT_GAP_ADV_TYPE_ADV_IND,
+    BT_GAP_ADV_TYPE_SCAN_RSP,
+};
+
+static bt_addr_le_t nodes[NODES];
+static uint8_t ad[REPORT_TYPES][BT_GAP_ADV_MAX_ADV_DATA_LEN];
+static size_t ad_len[REPORT_TYPES];
+
+/* Manufacturer data with a counter ends both reports */
+static size_t counter_add(uint8_t *data, size_t len)
+{
+    data[len++] = 1 + sizeof(uint16_t) + sizeof(uint32_t);
+    data[len++] = BT_DATA_MANUFACTURER_DATA;
+    sys_put_le16(0xffff, &data[len]);
+    len += sizeof(uint16_t);
+    sys_put_le32(0, &data[len]);
+    len += sizeof(uint32_t);
+
+    return len;
+}
+
+static void reports_build(void)
+{
+    /* Nodes idle without a sync request, so none is offered to the
+       scheduler */
+    struct pouch_gatt_adv_data adv_data = {
+        .version = POUCH_GATT_VERSION,
+        .flags = 0,
+    };
+    static const char name[] = "pouch";
+    uint8_t *data = ad[0];
+    size_t len = 0;
+
+    data[len++] = 2;
+    data[len++] = BT_DATA_FLAGS;
+    data[len++] = BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR;
+    data[len++] = 1 + sizeof(uint16_t) + sizeof(adv_data);
+    data[len++] = BT_DATA_SVC_DATA16;
+    sys_put_le16(POUCH_GATT_UUID_SVC_VAL_16, &data[len]);
+    len += sizeof(uint16_t);
+    memcpy(&data[len], &adv_data, sizeof(adv_data));
+    len += sizeof(adv_data);
+    ad_len[0] = counter_add(data, len);
+
+    data = ad[1];
+    len = 0;
+
+    data[len++] = 1 + sizeof(name) - 1;
+    data[len++] = BT_DATA_NAME_COMPLETE;
+    memcpy(&data[len], name, sizeof(name) - 1);
+    len += sizeof(name) - 1;
+    ad_len[1] = counter_add(data, len);
+
+    /* Random static addresses, which map to distinct slots of the
+       default dedup cache */
+    for (int i = 0; i < NODES; i++)
+    {
+        nodes[i].type = BT_ADDR_LE_RANDOM;
+        memset(nodes[i].a.val, 0, sizeof(nodes[i].a.val));
+        nodes[i].a.val[0] = 4 + i;
+        nodes[i].a.val[5] = 0xc0;
+    }
+}
+
+static uint64_t run(bool changing)
+{
+    struct bt_le_scan_recv_info info = {
+        .rssi = -60,
+        .primary_phy = BT_GAP_LE_PHY_1M,
+        .secondary_phy = 0,
+    };
+    struct net_buf_simple buf;
+
+    uint64_t start = bench_host_time_ns();
+
+    for (uint32_t i = 0; i < REPORTS; i++)
+    {
+        int type = i % REPORT_TYPES;
+
+        info.addr = &nodes[(i / REPORT_TYPES) % NODES];
+        info.adv_type = report_types[type];
+        info.adv_props = BT_GAP_ADV_PROP_CONNECTABLE | BT_GAP_ADV_PROP_SCANNABLE;
+        if (BT_GAP_ADV_TYPE_SCAN_RSP == info.adv_type)
+        {
+            info.adv_props |= BT_GAP_ADV_PROP_SCAN_RESPONSE;
+        }
+
+        /* Counted from 1, so that no report matches a repeated one */
+        if (changing)
+        {
+            sys_put_le32(i + 1, &ad[type][ad_len[type] - sizeof(uint32_t)]);
+        }
+
+        /* Parsing consumes the buffer */
+        net_buf_simple_init_with_data(&buf, ad[type], ad_len[type]);
+
+        scan_cb->recv(&info, &buf);
+    }
+
+    uint64_t elapsed_ns = MAX(bench_host_time_ns() - start, 1);
+
+    if (changing)
+    {
+        for (int type = 0; type < REPORT_TYPES; type++)
+        {
+            sys_put_le32(0, &ad[type][ad_len[type] - sizeof(uint32_t)]);
+        }
+    }
+
+    return (uint64_t) REPORTS * NSEC_PER_SEC / elapsed_ns;
+}
+
+static void report(const char *name, bool changing, uint32_t expected_processed)
+{
+    struct pouch_gateway_scan_stats before;
+    struct pouch_gateway_scan_stats after;
+
+    pouch_gateway_scan_stats_get(&before);
+
+    uint64_t rate = run(changing);
+
+    pouch_gateway_scan_stats_get(&after);
+
+    uint32_t seen = after.seen - before.seen;
+    uint32_t deduped = after.deduped - before.deduped;
+    uint32_t processed = after.processed - before.processed;
+
+    TC_PRINT("%s reports from %d nodes: %llu reports/s (%u processed, %u deduped)\n",
+             name,
+             NODES,
+             rate,
+             processed,
+             deduped);
+
+    zassert_equal(seen, REPORTS);
+    zassert_equal(processed, expected_processed);
+}
+
+ZTEST(scan, test_repeated)
+{
+    /* The kernel clock stands still while reports are fed, so decisions
+       do not expire. Only the first advertisement and scan response of
+       each node are parsed. */
+    report("Repeated",
+           false,
+           IS_ENABLED(CONFIG_POUCH_GATEWAY_GATT_SCAN_DEDUP) ? NODES * REPORT_TYPES : REPORTS);
+}
+
+ZTEST(scan, test_changing)
+{
+    report("Changing", true, REPORTS);
+}
+
+static void *scan_setup(void)
+{
+    reports_build();
+
+    pouch_gateway_scan_start();
+    zassert_not_null(scan_cb);
+
+    return NULL;
+}
+
+ZTEST_SUITE(scan, NULL, scan_setup, NULL, NULL, NULL);
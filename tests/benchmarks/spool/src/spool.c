@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Spool throughput: pouches received while the cloud is unavailable are
+   written to LittleFS on the simulated flash, then drained once the cloud
+   is back. Writing is measured with the host clock, as it is processing
+   cost. Draining is paced by the simulated cloud round trip time, so it
+   is measured with the kernel clock. */
+
+#include <string.h>
+
+#include <zephyr/fs/fs.h>
+#include <zephyr/fs/littlefs.h>
+#include <zephyr/kernel.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/ztest.h>
+
+#include <pouch_gateway/downlink.h>
+#include <pouch_gateway/uplink.h>
+
+#include "cloud.h"
+#include "host_clock.h"
+
+#define POUCHES 8
+#define POUCH_LEN (16 * 1024)
+#define DRAIN_RTT_MS 50
+
+/* ATT payload of a notification with the gateway's MTU of 247 bytes */
+#define CHUNK_LEN 244
+
+FS_LITTLEFS_DECLARE_DEFAULT_CONFIG(lfs_data);
+
+static struct fs_mount_t lfs_mount = {
+    .type = FS_LITTLEFS,
+    .fs_data = &lfs_data,
+    .storage_dev = (void *) FIXED_PARTITION_ID(spool_partition),
+    .mnt_point = "/lfs",
+};
+
+static uint8_t pouch[CHUNK_LEN];
+static enum pouch_gateway_uplink_result uplink_result;
+static K_SEM_DEFINE(uplink_ended, 0, 1);
+static K_SEM_DEFINE(uplink_writable, 0, 1);
+
+static void uplink_end_cb(void *arg, enum pouch_gateway_uplink_result res)
+{
+    uplink_result = res;
+    k_sem_give(&uplink_ended);
+}
+
+static void uplink_writable_cb(void *arg)
+{
+    k_sem_give(&uplink_writable);
+}
+
+static void downlink_data_available(void *arg) {}
+
+static void spool_pouch(void)
+{
+    struct pouch_gateway_downlink_context *downlink =
+        pouch_gateway_downlink_open(downlink_data_available, NULL);
+    zassert_not_null(downlink);
+
+    struct pouch_gateway_uplink *uplink =
+        pouch_gateway_uplink_open(downlink, uplink_end_cb, uplink_writable_cb, NULL);
+    zassert_not_null(uplink);
+
+    for (size_t offset = 0; offset < POUCH_LEN; offset += CHUNK_LEN)
+    {
+        size_t len = MIN(CHUNK_LEN, POUCH_LEN - offset);
+
+        while (pouch_gateway_uplink_is_congested(uplink, len))
+        {
+            k_sem_take(&uplink_writable, K_FOREVER);
+        }
+
+        zassert_ok(pouch_gateway_uplink_write(uplink, pouch, len, offset + len == POUCH_LEN));
+    }
+
+    pouch_gateway_uplink_close(uplink);
+
+    zassert_ok(k_sem_take(&uplink_ended, K_SECONDS(10)));
+    zassert_equal(uplink_result, POUCH_GATEWAY_UPLINK_SUCCESS);
+
+    /* The node has received the empty downlink of a spooled pouch */
+    pouch_gateway_downlink_abort(downlink);
+}
+
+ZTEST(spool, test_throughput)
+{
+    struct pouch_gateway_spool_stats stats;
+
+    cloud_connected_set(false);
+
+    uint64_t start = bench_host_time_ns();
+
+    for (int i = 0; i < POUCHES; i++)
+    {
+        spool_pouch();
+    }
+
+    uint64_t elapsed_ns = MAX(bench_host_time_ns() - start, 1);
+
+    pouch_gateway_uplink_spool_stats_get(&stats);
+    zassert_equal(stats.depth_files, POUCHES);
+
+    TC_PRINT("Spooled %d pouches of %d bytes: %llu bytes/s\n",
+             POUCHES,
+             POUCH_LEN,
+             (uint64_t) POUCHES * POUCH_LEN * NSEC_PER_SEC / elapsed_ns);
+
+    cloud_connected_set(true);
+    cloud_rtt_set(DRAIN_RTT_MS);
+
+    int64_t drain_start = k_uptime_get();
+
+    pouch_gateway_uplink_spool_drain();
+
+    do
+    {
+        zassert_true(k_uptime_get() - drain_start < 60 * MSEC_PER_SEC, "Drain stalled");
+        k_sleep(K_MSEC(10));
+        pouch_gateway_uplink_spool_stats_get(&stats);
+    } while (stats.depth_files > 0);
+
+    int64_t drain_elapsed = MAX(k_uptime_get() - drain_start, 1);
+
+    zassert_equal(stats.drained_files, POUCHES);
+
+    TC_PRINT("Drained %d pouches, RTT %u ms, %d at a time: %llu bytes/s\n",
+             POUCHES,
+             DRAIN_RTT_MS,
+             CONFIG_POUCH_GATEWAY_SPOOL_DRAIN_CONCURRENCY,
+             (uint64_t) POUCHES * POUCH_LEN * MSEC_PER_SEC / drain_elapsed);
+}
+
+static void *spool_setup(void)
+{
+    const struct flash_area *fa;
+    struct pouch_gateway_spool_stats stats;
+
+    memset(pouch, 0xa5, sizeof(pouch));
+
+    /* The simulated flash is kept in a file, so start from an empty spool */
+    zassert_ok(flash_area_open(FIXED_PARTITION_ID(spool_partition), &fa));
+    zassert_ok(flash_area_erase(fa, 0, fa->fa_size));
+    flash_area_close(fa);
+
+    zassert_ok(fs_mount(&lfs_mount));
+
+    pouch_gateway_uplink_module_init(cloud_client);
+
+    /* Scan the spool now that the file system is mounted. The scan runs
+       on the spool work queue, and finds nothing to drain. */
+    pouch_gateway_uplink_spool_drain();
+    k_sleep(K_MSEC(100));
+
+    pouch_gateway_uplink_spool_stats_get(&stats);
+    zassert_equal(stats.depth_files, 0);
+
+    return NULL;
+}
+
+ZTEST_SUITE(spool, NULL, spool_setup, NULL, NULL, NULL);
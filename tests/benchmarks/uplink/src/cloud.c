@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Stand-in for the Golioth gateway API, linked in place of the real one with
+   --wrap. Blocks are acknowledged after a configurable round trip time, on
+   the system work queue like the client thread would. */
+
+#include <stdbool.h>
+
+#include <zephyr/kernel.h>
+
+#include <golioth/golioth_status.h>
+
+#include "cloud.h"
+
+struct golioth_coap_rsp_code;
+
+typedef void (*block_cb_fn)(struct golioth_client *client,
+                            enum golioth_status status,
+                            const struct golioth_coap_rsp_code *coap_rsp_code,
+                            const char *path,
+                            size_t block_size,
+                            void *arg);
+
+struct pending_block
+{
+    struct k_work_delayable work;
+    block_cb_fn cb;
+    void *arg;
+    size_t len;
+    bool used;
+};
+
+static uint8_t client_storage;
+struct golioth_client *const cloud_client = (struct golioth_client *) &client_storage;
+
+static uint8_t session_storage;
+static bool connected = true;
+
+static struct pending_block pending[CONFIG_POUCH_GATEWAY_UPLINK_NUM_BLOCKS];
+static K_MUTEX_DEFINE(pending_lock);
+
+static uint32_t rtt_ms;
+static uint32_t next_idx;
+static uint32_t out_of_order;
+static uint32_t inflight;
+static uint32_t inflight_peak;
+
+static void block_ack(struct pending_block *block)
+{
+    block_cb_fn cb = block->cb;
+    void *arg = block->arg;
+    size_t len = block->len;
+
+    k_mutex_lock(&pending_lock, K_FOREVER);
+    block->used = false;
+    inflight--;
+    k_mutex_unlock(&pending_lock);
+
+    cb(cloud_client, GOLIOTH_OK, NULL, NULL, len, arg);
+}
+
+static void block_ack_work_handler(struct k_work *work)
+{
+    block_ack(CONTAINER_OF(k_work_delayable_from_work(work), struct pending_block, work));
+}
+
+void cloud_rtt_set(uint32_t ms)
+{
+    rtt_ms = ms;
+}
+
+uint32_t cloud_blocks_out_of_order(void)
+{
+    return out_of_order;
+}
+
+uint32_t cloud_blocks_inflight_peak(void)
+{
+    return inflight_peak;
+}
+
+void cloud_connected_set(bool is_connected)
+{
+    connected = is_connected;
+}
+
+void cloud_reset(void)
+{
+    k_mutex_lock(&pending_lock, K_FOREVER);
+    next_idx = 0;
+    out_of_order = 0;
+    inflight_peak = 0;
+    k_mutex_unlock(&pending_lock);
+}
+
+bool __wrap_golioth_client_is_connected(struct golioth_client *client)
+{
+    return client == cloud_client && connected;
+}
+
+void *__wrap_golioth_gateway_uplink_start(struct golioth_client *client,
+                                          void *block_cb,
+                                          void *end_cb,
+                                          void *arg)
+{
+    return &session_storage;
+}
+
+void __wrap_golioth_gateway_uplink_finish(void *session) {}
+
+enum golioth_status __wrap_golioth_gateway_uplink_block(void *session,
+                                                        uint32_t block_idx,
+                                                        const uint8_t *data,
+                                                        size_t len,
+                                                        bool is_last,
+                                                        block_cb_fn cb,
+                                                        void *arg)
+{
+    struct pending_block *block = NULL;
+
+    k_mutex_lock(&pending_lock, K_FOREVER);
+
+    if (block_idx != next_idx)
+    {
+        out_of_order++;
+    }
+    next_idx = block_idx + 1;
+
+    for (size_t i = 0; i < ARRAY_SIZE(pending); i++)
+    {
+        if (!pending[i].used)
+        {
+            block = &pending[i];
+            block->used = true;
+            break;
+        }
+    }
+
+    if (block != NULL)
+    {
+        inflight++;
+        inflight_peak = MAX(inflight_peak, inflight);
+    }
+
+    k_mutex_unlock(&pending_lock);
+
+    if (block == NULL)
+    {
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    block->cb = cb;
+    block->arg = arg;
+    block->len = len;
+
+    if (rtt_ms == 0)
+    {
+        block_ack(block);
+    }
+    else
+    {
+        k_work_init_delayable(&block->work, block_ack_work_handler);
+        k_work_schedule(&block->work, K_MSEC(rtt_ms));
+    }
+
+    return GOLIOTH_OK;
+}
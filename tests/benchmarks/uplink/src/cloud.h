@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <golioth/client.h>
+
+/** Client handed to the uplink module, which the simulated cloud accepts */
+extern struct golioth_client *const cloud_client;
+
+/**
+ * Set the time the simulated cloud takes to acknowledge a block.
+ *
+ * @param rtt_ms Round trip time in milliseconds. Blocks are acknowledged
+ * before the upload call returns if 0.
+ */
+void cloud_rtt_set(uint32_t rtt_ms);
+
+/**
+ * Set whether the client reports being connected to the simulated cloud.
+ *
+ * @param is_connected false to make the gateway spool uplinks. Connected by default.
+ */
+void cloud_connected_set(bool is_connected);
+
+/** Number of blocks the simulated cloud received out of order */
+uint32_t cloud_blocks_out_of_order(void);
+
+/** Highest number of blocks the simulated cloud had in flight at once */
+uint32_t cloud_blocks_inflight_peak(void);
+
+/** Forget blocks seen so far, before starting a new uplink */
+void cloud_reset(void);
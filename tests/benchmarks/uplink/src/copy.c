@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Processing cost of passing received data to the uplink, through
+   pouch_gateway_uplink_write() and through reserve/commit. The simulated
+   cloud acknowledges blocks right away, so only the gateway's own work is
+   measured. */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#include <pouch_gateway/uplink.h>
+
+#include "cloud.h"
+#include "host_clock.h"
+
+#define POUCH_LEN (64 * 1024)
+#define RUNS 32
+
+/* ATT payload of a notification with the gateway's MTU of 247 bytes */
+#define CHUNK_LEN 244
+
+typedef int (*uplink_write_fn)(struct pouch_gateway_uplink *uplink,
+                               const uint8_t *data,
+                               size_t len,
+                               bool is_last);
+
+static uint8_t pouch[POUCH_LEN];
+static enum pouch_gateway_uplink_result uplink_result;
+static K_SEM_DEFINE(uplink_ended, 0, 1);
+
+static void uplink_end_cb(void *arg, enum pouch_gateway_uplink_result res)
+{
+    uplink_result = res;
+    k_sem_give(&uplink_ended);
+}
+
+static int write_reserve_commit(struct pouch_gateway_uplink *uplink,
+                                const uint8_t *data,
+                                size_t len,
+                                bool is_last)
+{
+    while (len > 0)
+    {
+        uint8_t *buf;
+        size_t room;
+
+        int err = pouch_gateway_uplink_reserve(uplink, &buf, &room);
+        if (err)
+        {
+            return err;
+        }
+
+        room = MIN(room, len);
+        memcpy(buf, data, room);
+        data += room;
+        len -= room;
+
+        err = pouch_gateway_uplink_commit(uplink, room, is_last && len == 0);
+        if (err)
+        {
+            return err;
+        }
+    }
+
+    return 0;
+}
+
+static uint64_t run(uplink_write_fn write)
+{
+    struct pouch_gateway_uplink *uplink =
+        pouch_gateway_uplink_open(NULL, uplink_end_cb, NULL, NULL);
+    zassert_not_null(uplink);
+
+    uint64_t start = bench_host_time_ns();
+
+    for (size_t offset = 0; offset < POUCH_LEN; offset += CHUNK_LEN)
+    {
+        size_t len = MIN(CHUNK_LEN, POUCH_LEN - offset);
+
+        zassert_ok(write(uplink, &pouch[offset], len, offset + len == POUCH_LEN));
+    }
+
+    uint64_t elapsed = bench_host_time_ns() - start;
+
+    pouch_gateway_uplink_close(uplink);
+
+    zassert_ok(k_sem_take(&uplink_ended, K_SECONDS(1)));
+    zassert_equal(uplink_result, POUCH_GATEWAY_UPLINK_SUCCESS);
+
+    return elapsed;
+}
+
+static void report(const char *name, uplink_write_fn write)
+{
+    uint64_t best = UINT64_MAX;
+
+    for (int i = 0; i < RUNS; i++)
+    {
+        best = MIN(best, run(write));
+    }
+
+    TC_PRINT("%s: %llu ns per KB\n", name, best * 1024 / POUCH_LEN);
+}
+
+ZTEST(uplink_copy, test_write)
+{
+    report("pouch_gateway_uplink_write()", pouch_gateway_uplink_write);
+}
+
+ZTEST(uplink_copy, test_reserve_commit)
+{
+    report("reserve/commit", write_reserve_commit);
+}
+
+static void *uplink_copy_setup(void)
+{
+    memset(pouch, 0xa5, sizeof(pouch));
+
+    pouch_gateway_uplink_module_init(cloud_client);
+
+    return NULL;
+}
+
+static void uplink_copy_before(void *fixture)
+{
+    cloud_reset();
+    cloud_rtt_set(0);
+}
+
+ZTEST_SUITE(uplink_copy, NULL, uplink_copy_setup, uplink_copy_before, NULL, NULL);
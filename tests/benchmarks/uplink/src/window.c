@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2026 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Uplink throughput against the cloud round trip time, for the window
+   configured with CONFIG_POUCH_GATEWAY_UPLINK_WINDOW. The node is simulated
+   as sending as fast as the uplink accepts data, so the cloud is the only
+   bottleneck. Time is simulated, so results do not depend on the host. */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#include <pouch_gateway/uplink.h>
+
+#include "cloud.h"
+
+#define POUCH_LEN (32 * 1024)
+
+/* ATT payload of a notification with the gateway's MTU of 247 bytes */
+#define CHUNK_LEN 244
+
+static const uint32_t rtts_ms[] = {20, 50, 100, 200, 500};
+
+static uint8_t pouch[CHUNK_LEN];
+static enum pouch_gateway_uplink_result uplink_result;
+static K_SEM_DEFINE(uplink_ended, 0, 1);
+static K_SEM_DEFINE(uplink_writable, 0, 1);
+
+static void uplink_end_cb(void *arg, enum pouch_gateway_uplink_result res)
+{
+    uplink_result = res;
+    k_sem_give(&uplink_ended);
+}
+
+static void uplink_writable_cb(void *arg)
+{
+    k_sem_give(&uplink_writable);
+}
+
+static uint32_t run(uint32_t rtt_ms)
+{
+    cloud_reset();
+    cloud_rtt_set(rtt_ms);
+    k_sem_reset(&uplink_writable);
+
+    struct pouch_gateway_uplink *uplink =
+        pouch_gateway_uplink_open(NULL, uplink_end_cb, uplink_writable_cb, NULL);
+    zassert_not_null(uplink);
+
+    int64_t start = k_uptime_get();
+
+    for (size_t offset = 0; offset < POUCH_LEN; offset += CHUNK_LEN)
+    {
+        size_t len = MIN(CHUNK_LEN, POUCH_LEN - offset);
+
+        while (pouch_gateway_uplink_is_congested(uplink, len))
+        {
+            k_sem_take(&uplink_writable, K_FOREVER);
+        }
+
+        zassert_ok(pouch_gateway_uplink_write(uplink, pouch, len, offset + len == POUCH_LEN));
+    }
+
+    pouch_gateway_uplink_close(uplink);
+
+    zassert_ok(k_sem_take(&uplink_ended, K_SECONDS(60)));
+    zassert_equal(uplink_result, POUCH_GATEWAY_UPLINK_SUCCESS);
+    zassert_equal(cloud_blocks_out_of_order(), 0, "Blocks submitted out of order");
+    zassert_true(cloud_blocks_inflight_peak() <= CONFIG_POUCH_GATEWAY_UPLINK_WINDOW);
+
+    int64_t elapsed = MAX(k_uptime_get() - start, 1);
+
+    return POUCH_LEN * MSEC_PER_SEC / elapsed;
+}
+
+ZTEST(uplink_window, test_throughput)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(rtts_ms); i++)
+    {
+        TC_PRINT("Window %d, RTT %u ms: %u bytes/s\n",
+                 CONFIG_POUCH_GATEWAY_UPLINK_WINDOW,
+                 rtts_ms[i],
+                 run(rtts_ms[i]));
+    }
+}
+
+static void *uplink_window_setup(void)
+{
+    pouch_gateway_uplink_module_init(cloud_client);
+
+    return NULL;
+}
+
+ZTEST_SUITE(uplink_window, NULL, uplink_window_setup, NULL, NULL, NULL);